@@ -10,7 +10,9 @@
 #include <sfe/DataTypeTrait.h>
 
 #include <render/Texture.h>
+#include <render/TextureCache.h>
 
+#include <algorithm>
 #include <cctype>
 #include <iostream>
 #include <future>
@@ -85,11 +87,13 @@ SofaDocument::SofaDocument(const std::string& type, sfe::Simulation simulation)
 	, m_graphImages(m_graph)
 	, m_simulation(simulation)
 {
+	m_mouseManipulator.setPickCallback([this](const simplerender::PickResult& result) { selectInstance(result); });
 }
 
 void SofaDocument::initUI(simplegui::SimpleGUI& gui)
 {
 	m_gui = &gui;
+	simplerender::ShaderProgram::setBinaryCacheDirectory(gui.cacheDirectory()); // Used by initOpenGL
 
 	// Buttons box
 	auto& panel = m_gui->buttonsPanel();
@@ -111,9 +115,24 @@ void SofaDocument::initUI(simplegui::SimpleGUI& gui)
 
 	m_updateGraphButton = panel.addButton("Update graph", "Update the graph based on the current state of the simulation", [this](){ createGraph(); }, 2, 0, 1, 2);
 
+	// Menu actions
+	int computeNormals = 0;
+	m_gui->settings().get("computeNormals", computeNormals);
+	m_computeNormals = (computeNormals != 0);
+
+	auto& menu = m_gui->getMenu(simplegui::MenuType::Tools);
+	m_computeNormalsButton = menu.addItem("Compute normals", "Only transfer the positions from Sofa and compute the normals locally", [this](){
+		m_computeNormals = !m_computeNormals;
+		m_gui->settings().set("computeNormals", m_computeNormals ? 1 : 0);
+	});
+	m_computeNormalsButton->setCheckable(true);
+	m_computeNormalsButton->setChecked(m_computeNormals);
+
 	// Status bar
 	m_statusFPS = m_gui->addStatusBarZone("FPS: 9999.9"); // Reasonable width for the fps counter
 	m_gui->setStatusBarText(m_statusFPS, ""); // Set it to empty because we do not have the fps information yet
+
+	m_renderUI.init(gui); // Textures settings and status
 }
 
 void SofaDocument::initOpenGL()
@@ -136,14 +155,18 @@ void SofaDocument::render()
 		material->init();
 	m_newMaterials.clear();
 
-	if(m_updateObjects)
+	// Take the newest frame published by the simulation thread (if any)
+	for (auto& sofaModel : m_sofaModels)
 	{
-		for(auto mesh : m_scene.meshes())
-			mesh->updatePositions();
-		m_updateObjects = false;
+		if (sofaModel.frames && sofaModel.frames->update())
+		{
+			sofaModel.mesh->swapFrame(sofaModel.frames->front());
+			sofaModel.mesh->updatePositions();
+		}
 	}
 
 	m_scene.render();
+	m_renderUI.update();
 }
 
 bool SofaDocument::mouseEvent(const MouseEvent& event)
@@ -151,6 +174,27 @@ bool SofaDocument::mouseEvent(const MouseEvent& event)
 	return m_mouseManipulator.mouseEvent(event);
 }
 
+void SofaDocument::selectInstance(const simplerender::PickResult& result)
+{
+	if (!m_gui || !result.instance || !m_graph.root())
+		return;
+
+	// The BVH of the mesh is refitted by updatePositions after each step, so the ray hits the simulated positions
+	auto model = std::find_if(m_sofaModels.begin(), m_sofaModels.end(), [&result](const SofaModel& sofaModel) {
+		return sofaModel.mesh == result.instance->mesh;
+	});
+	if (model == m_sofaModels.end())
+		return;
+
+	const auto id = model->m_sofaObject.uniqueId();
+	auto nodes = graph::getNodes(m_graph.root(), [id](GraphNode* baseNode) {
+		auto node = dynamic_cast<SofaNode*>(baseNode);
+		return node && node->isObject && node->uniqueId == id;
+	});
+	if (!nodes.empty())
+		m_gui->selectNode(nodes.front());
+}
+
 SofaDocument::SofaModel SofaDocument::createSofaModel(sfe::Object& visualModel)
 {
 	SofaModel sofaModel;
@@ -169,16 +213,21 @@ SofaDocument::SofaModel SofaDocument::createSofaModel(sfe::Object& visualModel)
 		sofaModel.d_vertices = vertData;
 	sofaModel.d_normals = visualModel.data("normal");
 
-	if (!sofaModel.d_vertices || !sofaModel.d_normals)
+	if (!sofaModel.d_vertices)
 		return sofaModel;
 
 	auto mesh = std::make_shared<simplerender::Mesh>();
 	sofaModel.mesh = mesh;
+	sofaModel.frames = std::make_shared<simplerender::MeshFrameBuffer>();
+	mesh->setStorageMode(simplerender::StorageMode::Streaming); // Modified at every step
+	mesh->setAttributesFormat(simplerender::AttributesFormat::Compact);
+	mesh->setChangesDetection(true); // Often only a part of the model moves, we will upload only the modified vertices
 	m_scene.addMesh(mesh);
 	m_newMeshes.push_back(mesh);
 
 	sofaModel.d_vertices.get(mesh->m_vertices);
-	sofaModel.d_normals.get(mesh->m_normals);
+	if (sofaModel.d_normals && !m_computeNormals)
+		sofaModel.d_normals.get(mesh->m_normals);
 
 	// Get the constant information (topology and color)
 	// Triangles
@@ -194,6 +243,13 @@ SofaDocument::SofaModel SofaDocument::createSofaModel(sfe::Object& visualModel)
 	if (mesh->m_triangles.empty() && mesh->m_quads.empty())
 		return sofaModel;
 
+	// Prepare the computation of the normals, in case we do not want to transfer them at each step
+	mesh->mergeIndices();
+	sofaModel.normalsComputation = std::make_shared<simplerender::NormalsComputation>();
+	sofaModel.normalsComputation->setTopology(mesh->m_mergedTriangles, mesh->m_vertices.size());
+	if (!sofaModel.d_normals || m_computeNormals)
+		sofaModel.normalsComputation->compute(mesh->m_vertices, mesh->m_normals);
+
 	auto texCoordsData = visualModel.data("texcoords");
 	if (texCoordsData)
 		texCoordsData.get(mesh->m_texCoords);
@@ -218,10 +274,7 @@ SofaDocument::SofaModel SofaDocument::createSofaModel(sfe::Object& visualModel)
 		{
 			auto contents = helper->loadFile(tex.filePath);
 			if (!contents.empty())
-			{
-				tex.texture = std::make_shared<simplerender::Texture>();
-				tex.texture->loadFromMemory(contents);
-			}
+				tex.texture = simplerender::TextureCache::instance().fromMemory(contents);
 		}
 	}
 
@@ -255,10 +308,25 @@ void SofaDocument::setupCallbacks()
 
 void SofaDocument::updateObjects()
 {
-	for(auto sofaModel : m_sofaModels)
+	// Write in the back buffers, the render thread will take them when it is ready
+	for(auto& sofaModel : m_sofaModels)
 	{
-		sofaModel.d_vertices.get(sofaModel.mesh->m_vertices);
-		sofaModel.d_normals.get(sofaModel.mesh->m_normals);
+		if (!sofaModel.frames)
+			continue;
+
+		auto& frame = sofaModel.frames->back();
+		sofaModel.d_vertices.get(frame.vertices);
+
+		// Fall back to the Data if the number of vertices has changed
+		const bool computeNormals = sofaModel.normalsComputation && (m_computeNormals || !sofaModel.d_normals);
+		if (!computeNormals || !sofaModel.normalsComputation->compute(frame.vertices, frame.normals))
+		{
+			if (sofaModel.d_normals)
+				sofaModel.d_normals.get(frame.normals);
+			else // Edges only, or no normals Data and the number of vertices has changed
+				frame.normals.clear();
+		}
+		sofaModel.frames->publish();
 	}
 }
 
@@ -350,8 +418,7 @@ void SofaDocument::postStep()
 	// Udpate properties in opened dialogs
 	std::async(&SofaDocument::updateProperties, this);
 
-	updateObjects();
-	m_updateObjects = true; // We have to modify the buffers in the correct thread
+	updateObjects(); // The buffers will be modified in the render thread
 	m_gui->updateView();
 
 	m_animateButton->setChecked(m_simulation.isAnimating());
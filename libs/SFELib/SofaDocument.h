@@ -3,14 +3,17 @@
 #include <core/BaseDocument.h>
 #include <core/Graph.h>
 #include <core/MouseManipulator.h>
+#include <core/RenderUI.h>
 #include <core/SimpleGUI.h>
 
+#include <render/NormalsComputation.h>
 #include <render/Scene.h>
 
 #include <sfe/Simulation.h>
 
 #include "GraphImages.h"
 
+#include <atomic>
 #include <chrono>
 
 class SofaDocument : public BaseDocument
@@ -51,21 +54,25 @@ protected:
 		simplerender::Material::SPtr material;
 		sfe::Object m_sofaObject; // Proxy to the Sofa object in the simulation
 		sfe::Data d_vertices, d_normals; // Proxies to access the fields we need in the Sofa object
+		std::shared_ptr<simplerender::MeshFrameBuffer> frames; // Written in the simulation thread, read in the render thread
+		std::shared_ptr<simplerender::NormalsComputation> normalsComputation; // Used instead of d_normals if m_computeNormals is true
 	};
 
 	SofaModel createSofaModel(sfe::Object& visualModel);
+	void selectInstance(const simplerender::PickResult& result); // Double click in the view
 
 	simplegui::SimpleGUI* m_gui = nullptr;
 	simplerender::Scene m_scene;
+	RenderUI m_renderUI;
 	Graph m_graph;
 	SofaMouseManipulator m_mouseManipulator;
 	std::vector<sfe::CallbackHandle> m_sfeCallbacks; // HACK: (TODO) the destruction order relating to the simulation is important
 	sfe::Simulation m_simulation;
 	GraphImages m_graphImages;
-	bool m_updateObjects = false;
 
 	double m_timestep = 0.02;
 	bool m_singleStep = false;
+	std::atomic<bool> m_computeNormals = { false }; // Only get the positions from Sofa, and compute the normals here
 	int m_statusFPS = -1, m_fpsCount = 0;
 	std::chrono::high_resolution_clock::time_point m_fpsStart;
 
@@ -73,7 +80,7 @@ protected:
 	std::vector<simplerender::Mesh::SPtr> m_newMeshes;
 	std::vector<simplerender::Material::SPtr> m_newMaterials;
 
-	simplegui::Button::SPtr m_animateButton, m_stepButton, m_resetButton, m_updateGraphButton;
+	simplegui::Button::SPtr m_animateButton, m_stepButton, m_resetButton, m_updateGraphButton, m_computeNormalsButton;
 };
 
 inline Graph& SofaDocument::graph()
@@ -14,6 +14,11 @@ SofaMouseManipulator::SofaMouseManipulator(simplerender::Scene& scene)
 
 }
 
+void SofaMouseManipulator::setPickCallback(const PickCallback& callback)
+{
+	m_pickCallback = callback;
+}
+
 bool SofaMouseManipulator::mouseEvent(const MouseEvent& event)
 {
 	switch(event.type)
@@ -36,6 +41,17 @@ bool SofaMouseManipulator::mouseEvent(const MouseEvent& event)
 		}
 		break;
 
+	case MouseEvent::EventType::MouseDoubleClick:
+	{
+		if (event.button != MouseEvent::LeftButton || !m_pickCallback)
+			return false;
+
+		simplerender::PickResult result;
+		if (m_scene.pick(event.x, event.y, event.width, event.height, result))
+			m_pickCallback(result);
+		return false; // The view is not modified
+	}
+
 	case MouseEvent::EventType::MouseRelease:
 		if(m_buttonPressed == event.button)
 		{
@@ -3,9 +3,12 @@
 #include <core/core.h>
 #include <core/MouseEvent.h>
 
+#include <functional>
+
 namespace simplerender 
 {
 	class Scene;
+	struct PickResult;
 }
 
 class CORE_API MouseManipulator
@@ -24,6 +27,10 @@ public:
 	SofaMouseManipulator(simplerender::Scene& scene);
 	bool mouseEvent(const MouseEvent& event) override;
 
+	// Called when the left button is double clicked over an instance of the scene
+	using PickCallback = std::function<void(const simplerender::PickResult&)>;
+	void setPickCallback(const PickCallback& callback);
+
 protected:
 	enum class MouseManipulation
 	{ None, Rotation, Translation, Zoom, };
@@ -31,4 +38,5 @@ protected:
 	int m_prevX = 0, m_prevY = 0;
 	MouseManipulation m_mouseManipulation = MouseManipulation::None;
 	unsigned char m_buttonPressed = 0; // Button responsible for the start of the manipulation
+	PickCallback m_pickCallback;
 };
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <core/SimpleGUI.h>
+
+#include <render/GLResources.h>
+#include <render/Texture.h>
+#include <render/TextureLoader.h>
+#include <render/TextureResidency.h>
+
+#include <algorithm>
+#include <string>
+
+// Settings and status bar zones common to the documents drawing a Scene
+// Only in this header, so that the render library does not depend on the GUI, and the module using it has the render singletons
+class RenderUI
+{
+public:
+	void init(simplegui::SimpleGUI& gui); // Applies the texture settings, and adds the status bar zones
+	void update(); // After Scene::render: updates the status bar zones, and draws again until the textures are decoded and uploaded
+
+protected:
+	simplegui::SimpleGUI* m_gui = nullptr;
+	int m_statusTextures = -1, m_statusResources = -1;
+	std::string m_statusTexturesText, m_statusResourcesText; // Only set when they change
+};
+
+//****************************************************************************//
+
+inline void RenderUI::init(simplegui::SimpleGUI& gui)
+{
+	using namespace simplerender;
+	m_gui = &gui;
+
+	// Memory of the textures, in megabytes
+	int textureBudget = static_cast<int>(defaultTextureBudget / (1024 * 1024));
+	gui.settings().get("textureBudget", textureBudget);
+	TextureResidency::instance().setBudget(static_cast<std::size_t>(std::max(textureBudget, 1)) * 1024 * 1024);
+
+	// Decoded textures with their mipmaps, the cache is disabled if the directory is set to an empty string
+	std::string textureCache = gui.cacheDirectory();
+	gui.settings().get("textureCacheDirectory", textureCache);
+	Texture::setCacheDirectory(textureCache);
+	int textureCacheSize = static_cast<int>(defaultTextureCacheSize / (1024 * 1024)); // In megabytes
+	gui.settings().get("textureCacheSize", textureCacheSize);
+	Texture::setCacheSize(static_cast<std::size_t>(std::max(textureCacheSize, 1)) * 1024 * 1024);
+
+	m_statusTextures = gui.addStatusBarZone("Textures: 9999 / 9999 MB (999 reduced)");
+	m_statusResources = gui.addStatusBarZone("GL: 9999 buffers, 999 VAOs, 999 textures, 99 programs"); // Live OpenGL objects, to see the leaks
+}
+
+inline void RenderUI::update()
+{
+	using namespace simplerender;
+	if (!m_gui)
+		return;
+
+	const auto texturesText = statusText(TextureResidency::instance().statistics());
+	if (texturesText != m_statusTexturesText)
+	{
+		m_statusTexturesText = texturesText;
+		m_gui->setStatusBarText(m_statusTextures, texturesText);
+	}
+
+	const auto resourcesText = statusText(glResourcesCounters());
+	if (resourcesText != m_statusResourcesText)
+	{
+		m_statusResourcesText = resourcesText;
+		m_gui->setStatusBarText(m_statusResources, resourcesText);
+	}
+
+	if (TextureLoader::instance().busy())
+		m_gui->updateView();
+}
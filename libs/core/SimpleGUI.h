@@ -167,7 +167,10 @@ public:
 	virtual void closeAllPropertiesDialogs() = 0;
 	virtual std::vector<ObjectPropertiesPair> getOpenedPropertiesDialogs() = 0;
 
+	virtual void selectNode(GraphNode* node) = 0; // Select the node in the graph view, expanding its parents
+
 	virtual Settings& settings() = 0;
+	virtual std::string cacheDirectory() = 0; // Writable directory next to the settings, for the files that can be regenerated
 
 	virtual void closeDocument() = 0; // Asks the UI to close the document (after all other events have been processed)
 	virtual void executeByUI(CallbackFunc func) = 0; // Put the function on a queue that will be executed on the UI thread
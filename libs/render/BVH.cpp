@@ -0,0 +1,256 @@
+#include <render/BVH.h>
+#include <render/Frustum.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+inline bool isEmpty(const simplerender::BVH::BoundingBox& box)
+{
+	return box.first.x > box.second.x || box.first.y > box.second.y || box.first.z > box.second.z;
+}
+
+inline glm::vec3 center(const simplerender::BVH::BoundingBox& box)
+{
+	return (box.first + box.second) * 0.5f;
+}
+
+}
+
+namespace simplerender
+{
+
+Ray::Ray(const glm::vec3& origin, const glm::vec3& direction)
+	: origin(origin)
+	, direction(direction)
+	, invDirection(1.f / direction.x, 1.f / direction.y, 1.f / direction.z) // Infinite for a null component, which the slabs test handles
+{
+}
+
+bool intersect(const Ray& ray, const glm::vec3& min, const glm::vec3& max, float maxDistance, float& entry)
+{
+	float tMin = 0.f, tMax = maxDistance;
+	for (int i = 0; i < 3; ++i)
+	{
+		float t0 = (min[i] - ray.origin[i]) * ray.invDirection[i];
+		float t1 = (max[i] - ray.origin[i]) * ray.invDirection[i];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tMin = t0 > tMin ? t0 : tMin; // Not std::max, to ignore the NaN of 0 * inf
+		tMax = t1 < tMax ? t1 : tMax;
+		if (tMin > tMax)
+			return false;
+	}
+
+	entry = tMin;
+	return true;
+}
+
+void BVH::build(const BoundingBoxes& boxes, unsigned int maxLeafSize)
+{
+	clear();
+	m_boxes = boxes;
+	m_itemsLeaves.assign(boxes.size(), -1);
+
+	const auto nb = static_cast<unsigned int>(boxes.size());
+	for (unsigned int i = 0; i < nb; ++i)
+	{
+		if (!isEmpty(boxes[i]))
+			m_items.push_back(i);
+	}
+
+	if (m_items.empty())
+		return;
+
+	m_nodes.reserve(2 * m_items.size());
+	m_nodes.emplace_back();
+	buildNode(0, 0, m_items.size(), std::max(maxLeafSize, 1u));
+}
+
+void BVH::clear()
+{
+	m_nodes.clear();
+	m_boxes.clear();
+	m_items.clear();
+	m_itemsLeaves.clear();
+}
+
+void BVH::buildNode(unsigned int nodeId, unsigned int first, unsigned int count, unsigned int maxLeafSize)
+{
+	if (count <= maxLeafSize)
+	{
+		auto& node = m_nodes[nodeId];
+		node.first = first;
+		node.count = count;
+		for (unsigned int i = first; i < first + count; ++i)
+			m_itemsLeaves[m_items[i]] = nodeId;
+		updateNode(node);
+		return;
+	}
+
+	// Split along the largest axis of the centers
+	glm::vec3 cMin(std::numeric_limits<float>::max()), cMax(-std::numeric_limits<float>::max());
+	for (unsigned int i = first; i < first + count; ++i)
+	{
+		auto c = center(m_boxes[m_items[i]]);
+		cMin = glm::min(cMin, c);
+		cMax = glm::max(cMax, c);
+	}
+
+	auto extent = cMax - cMin;
+	int axis = 0;
+	if (extent[1] > extent[axis]) axis = 1;
+	if (extent[2] > extent[axis]) axis = 2;
+
+	const auto mid = first + count / 2;
+	auto itFirst = m_items.begin() + first;
+	std::nth_element(itFirst, m_items.begin() + mid, itFirst + count, [this, axis](unsigned int lhs, unsigned int rhs) {
+		return center(m_boxes[lhs])[axis] < center(m_boxes[rhs])[axis];
+	});
+
+	const auto left = static_cast<unsigned int>(m_nodes.size());
+	m_nodes.emplace_back();
+	m_nodes.emplace_back();
+	m_nodes[left].parent = m_nodes[left + 1].parent = nodeId;
+	m_nodes[nodeId].first = left;
+	m_nodes[nodeId].count = 0;
+
+	buildNode(left, first, mid - first, maxLeafSize);
+	buildNode(left + 1, mid, first + count - mid, maxLeafSize);
+	updateNode(m_nodes[nodeId]);
+}
+
+void BVH::updateNode(Node& node)
+{
+	if (node.count)
+	{
+		node.min = glm::vec3(std::numeric_limits<float>::max());
+		node.max = glm::vec3(-std::numeric_limits<float>::max());
+		for (unsigned int i = node.first; i < node.first + node.count; ++i)
+		{
+			const auto& box = m_boxes[m_items[i]];
+			node.min = glm::min(node.min, box.first);
+			node.max = glm::max(node.max, box.second);
+		}
+	}
+	else
+	{
+		const auto& left = m_nodes[node.first];
+		const auto& right = m_nodes[node.first + 1];
+		node.min = glm::min(left.min, right.min);
+		node.max = glm::max(left.max, right.max);
+	}
+}
+
+bool BVH::refit(unsigned int item, const BoundingBox& box)
+{
+	if (item >= m_itemsLeaves.size() || m_itemsLeaves[item] == -1 || isEmpty(box))
+		return false;
+
+	m_boxes[item] = box;
+
+	// Go up until a node is not modified
+	int nodeId = m_itemsLeaves[item];
+	while (nodeId != -1)
+	{
+		auto& node = m_nodes[nodeId];
+		const auto prevMin = node.min, prevMax = node.max;
+		updateNode(node);
+		if (node.min == prevMin && node.max == prevMax)
+			break;
+		nodeId = node.parent;
+	}
+
+	return true;
+}
+
+void BVH::refit(const BoundingBoxes& boxes)
+{
+	m_boxes = boxes;
+
+	// Children are always after their parent
+	for (auto it = m_nodes.rbegin(); it != m_nodes.rend(); ++it)
+		updateNode(*it);
+}
+
+BVH::BoundingBox BVH::bounds() const
+{
+	if (m_nodes.empty())
+		return std::make_pair(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()));
+
+	return std::make_pair(m_nodes[0].min, m_nodes[0].max);
+}
+
+void BVH::frustumCull(const Frustum& frustum, Items& visibleItems) const
+{
+	visibleItems.clear();
+	if (m_nodes.empty())
+		return;
+
+	// The boolean is true if the node is completely inside the frustum, and does not have to be tested
+	std::vector<std::pair<unsigned int, bool>> stack;
+	stack.emplace_back(0, false);
+	while (!stack.empty())
+	{
+		auto current = stack.back();
+		stack.pop_back();
+
+		const auto& node = m_nodes[current.first];
+		bool inside = current.second;
+		if (!inside)
+		{
+			auto result = frustum.test(node.min, node.max);
+			if (result == Frustum::Intersection::Outside)
+				continue;
+			inside = (result == Frustum::Intersection::Inside);
+		}
+
+		if (node.count)
+			visibleItems.insert(visibleItems.end(), m_items.begin() + node.first, m_items.begin() + node.first + node.count);
+		else
+		{
+			stack.emplace_back(node.first + 1, inside);
+			stack.emplace_back(node.first, inside);
+		}
+	}
+}
+
+void BVH::raycast(const Ray& ray, RayHits& hits) const
+{
+	hits.clear();
+	if (m_nodes.empty())
+		return;
+
+	std::vector<unsigned int> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const auto& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		float entry = 0;
+		if (!intersect(ray, node.min, node.max, std::numeric_limits<float>::max(), entry))
+			continue;
+
+		if (!node.count)
+		{
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+			continue;
+		}
+
+		for (unsigned int i = node.first; i < node.first + node.count; ++i)
+		{
+			const auto item = m_items[i];
+			const auto& box = m_boxes[item];
+			if (intersect(ray, box.first, box.second, std::numeric_limits<float>::max(), entry))
+				hits.emplace_back(entry, item);
+		}
+	}
+
+	std::sort(hits.begin(), hits.end());
+}
+
+} // namespace simplerender
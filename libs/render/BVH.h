@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <utility>
+#include <vector>
+
+namespace simplerender
+{
+
+class Frustum;
+
+// The direction does not have to be normalized, the distances along the ray are in its unit
+struct Ray
+{
+	Ray() = default;
+	Ray(const glm::vec3& origin, const glm::vec3& direction);
+
+	glm::vec3 origin, direction;
+	glm::vec3 invDirection; // For the slabs test
+};
+
+// Returns true if the ray enters the box before maxDistance (entry is 0 if the origin is inside)
+bool intersect(const Ray& ray, const glm::vec3& min, const glm::vec3& max, float maxDistance, float& entry);
+
+// Bounding volume hierarchy over a list of axis aligned boxes (one per item)
+// Items with an empty box (min > max) are not inserted
+class BVH
+{
+public:
+	using BoundingBox = std::pair<glm::vec3, glm::vec3>;
+	using BoundingBoxes = std::vector<BoundingBox>;
+	using Items = std::vector<unsigned int>;
+
+	void build(const BoundingBoxes& boxes, unsigned int maxLeafSize = 1);
+	void clear();
+
+	bool refit(unsigned int item, const BoundingBox& box); // Update the box of one item and its parents. Returns false if the item is not in the hierarchy (it must be rebuilt)
+	void refit(const BoundingBoxes& boxes); // Update every box, keeping the same hierarchy
+
+	bool empty() const;
+	BoundingBox bounds() const; // Of the whole hierarchy
+
+	void frustumCull(const Frustum& frustum, Items& visibleItems) const; // Fills the list of items intersecting the frustum
+
+	using RayHits = std::vector<std::pair<float, unsigned int>>; // Entry distance in the box, and item
+	void raycast(const Ray& ray, RayHits& hits) const; // Fills the list of items whose box is hit, sorted by distance
+
+protected:
+	struct Node
+	{
+		glm::vec3 min, max;
+		unsigned int first = 0, count = 0; // If count > 0, the node is a leaf and this is a range in m_items. If not, first is the index of the left child (the right one follows)
+		int parent = -1;
+	};
+
+	void buildNode(unsigned int nodeId, unsigned int first, unsigned int count, unsigned int maxLeafSize);
+	void updateNode(Node& node); // Recompute the box of the node from its items or children
+
+	std::vector<Node> m_nodes; // Root first, children are always after their parent
+	BoundingBoxes m_boxes;
+	Items m_items; // Sorted by leaf
+	std::vector<int> m_itemsLeaves; // The leaf containing each item, -1 if not inserted
+};
+
+//****************************************************************************//
+
+inline bool BVH::empty() const
+{ return m_nodes.empty(); }
+
+} // namespace simplerender
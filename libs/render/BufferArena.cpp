@@ -0,0 +1,371 @@
+#include <render/BufferArena.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <algorithm>
+
+namespace
+{
+
+const std::size_t minVerticesCapacity = 1 << 16;
+const std::size_t minIndicesCapacity = 1 << 18;
+
+// Creates an uninitialized buffer, left bound to GL_COPY_WRITE_BUFFER
+GLuint createBuffer(std::size_t size)
+{
+	const GLuint buffer = simplerender::createGLResource(simplerender::GLResourceType::Buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+	return buffer;
+}
+
+}
+
+namespace simplerender
+{
+
+void RangeAllocator::reset(std::size_t capacity)
+{
+	m_capacity = capacity;
+	m_used = 0;
+	m_freeRanges.clear();
+	if (capacity)
+		m_freeRanges.emplace_back(0, capacity);
+}
+
+void RangeAllocator::grow(std::size_t capacity)
+{
+	if (capacity <= m_capacity)
+		return;
+
+	const auto oldCapacity = m_capacity;
+	m_capacity = capacity;
+	m_used += capacity - oldCapacity; // Removed by free
+	free(oldCapacity, capacity - oldCapacity);
+}
+
+std::size_t RangeAllocator::allocate(std::size_t size)
+{
+	auto it = std::find_if(m_freeRanges.begin(), m_freeRanges.end(), [size](const Range& range) {
+		return range.second >= size;
+	});
+
+	if (it == m_freeRanges.end())
+		return invalid;
+
+	const auto offset = it->first;
+	if (it->second == size)
+		m_freeRanges.erase(it);
+	else
+	{
+		it->first += size;
+		it->second -= size;
+	}
+
+	m_used += size;
+	return offset;
+}
+
+bool RangeAllocator::compact() const
+{
+	if (m_freeRanges.empty())
+		return true;
+
+	const auto& last = m_freeRanges.back();
+	return m_freeRanges.size() == 1 && last.first + last.second == m_capacity;
+}
+
+void RangeAllocator::free(std::size_t offset, std::size_t size)
+{
+	if (!size)
+		return;
+
+	m_used -= size;
+	auto next = std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), Range(offset, 0));
+
+	// Merge with the previous range and / or the next one
+	const bool mergePrevious = (next != m_freeRanges.begin() && std::prev(next)->first + std::prev(next)->second == offset);
+	const bool mergeNext = (next != m_freeRanges.end() && offset + size == next->first);
+	if (mergePrevious && mergeNext)
+	{
+		auto previous = std::prev(next);
+		previous->second += size + next->second;
+		m_freeRanges.erase(next);
+	}
+	else if (mergePrevious)
+		std::prev(next)->second += size;
+	else if (mergeNext)
+	{
+		next->first = offset;
+		next->second += size;
+	}
+	else
+		m_freeRanges.insert(next, Range(offset, size));
+}
+
+//****************************************************************************//
+
+ArenaAllocation::ArenaAllocation(const std::shared_ptr<BufferArena>& arena, std::size_t baseVertex, std::size_t nbVertices, std::size_t firstIndex, std::size_t nbIndices)
+	: baseVertex(baseVertex)
+	, nbVertices(nbVertices)
+	, firstIndex(firstIndex)
+	, nbIndices(nbIndices)
+	, m_arena(arena)
+{
+}
+
+ArenaAllocation::~ArenaAllocation()
+{
+	m_arena->free(*this);
+}
+
+//****************************************************************************//
+
+BufferArena::BufferArena(const Format& format)
+	: m_format(format)
+{
+}
+
+std::shared_ptr<ArenaAllocation> BufferArena::allocate(std::size_t nbVertices, std::size_t nbIndices)
+{
+	if (!m_VAO)
+		createBuffers(std::max(minVerticesCapacity, nbVertices), std::max(minIndicesCapacity, nbIndices));
+
+	auto baseVertex = m_verticesAllocator.allocate(nbVertices);
+	auto firstIndex = m_indicesAllocator.allocate(nbIndices);
+	if (baseVertex == RangeAllocator::invalid || firstIndex == RangeAllocator::invalid)
+	{
+		if (baseVertex != RangeAllocator::invalid)
+			m_verticesAllocator.free(baseVertex, nbVertices);
+		if (firstIndex != RangeAllocator::invalid)
+			m_indicesAllocator.free(firstIndex, nbIndices);
+
+		grow(nbVertices, nbIndices);
+		baseVertex = m_verticesAllocator.allocate(nbVertices);
+		firstIndex = m_indicesAllocator.allocate(nbIndices);
+	}
+
+	auto allocation = std::make_shared<ArenaAllocation>(shared_from_this(), baseVertex, nbVertices, firstIndex, nbIndices);
+	m_allocations.push_back(allocation.get());
+	return allocation;
+}
+
+void BufferArena::upload(const ArenaAllocation& allocation, const void* vertices, const void* indices)
+{
+	const auto stride = m_format.layout.stride;
+	glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, allocation.baseVertex * stride, allocation.nbVertices * stride, vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Not using GL_ELEMENT_ARRAY_BUFFER, as it would modify the VAO currently bound
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_indicesEBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * indexSize(), allocation.nbIndices * indexSize(), indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void BufferArena::free(ArenaAllocation& allocation)
+{
+	m_verticesAllocator.free(allocation.baseVertex, allocation.nbVertices);
+	m_indicesAllocator.free(allocation.firstIndex, allocation.nbIndices);
+
+	auto it = std::find(m_allocations.begin(), m_allocations.end(), &allocation);
+	if (it != m_allocations.end())
+	{
+		*it = m_allocations.back();
+		m_allocations.pop_back();
+	}
+}
+
+bool BufferArena::fragmented() const
+{
+	return !m_verticesAllocator.compact() || !m_indicesAllocator.compact();
+}
+
+void BufferArena::defragment()
+{
+	if (!m_VAO || !fragmented())
+		return;
+
+	// Copy each allocation after the previous one, in new buffers
+	const auto stride = m_format.layout.stride, idxSize = indexSize();
+	const GLuint oldVertices = m_verticesVBO, oldIndices = m_indicesEBO;
+	BufferHandle newVertices(createBuffer(m_verticesAllocator.capacity() * stride));
+	BufferHandle newIndices(createBuffer(m_indicesAllocator.capacity() * idxSize));
+
+	std::sort(m_allocations.begin(), m_allocations.end(), [](const ArenaAllocation* lhs, const ArenaAllocation* rhs) {
+		return lhs->baseVertex < rhs->baseVertex;
+	});
+
+	std::size_t nextVertex = 0, nextIndex = 0;
+	for (auto allocation : m_allocations)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, oldVertices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newVertices);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->baseVertex * stride, nextVertex * stride, allocation->nbVertices * stride);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, oldIndices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newIndices);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->firstIndex * idxSize, nextIndex * idxSize, allocation->nbIndices * idxSize);
+
+		allocation->baseVertex = nextVertex;
+		allocation->firstIndex = nextIndex;
+		nextVertex += allocation->nbVertices;
+		nextIndex += allocation->nbIndices;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Only one free range remains, at the end
+	m_verticesAllocator.reset(m_verticesAllocator.capacity());
+	m_verticesAllocator.allocate(nextVertex);
+	m_indicesAllocator.reset(m_indicesAllocator.capacity());
+	m_indicesAllocator.allocate(nextIndex);
+
+	m_verticesVBO = std::move(newVertices); // The previous buffers are released
+	m_indicesEBO = std::move(newIndices);
+	createBuffers(0, 0);
+}
+
+std::size_t BufferArena::indexSize() const
+{
+	return m_format.shortIndices ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+std::size_t BufferArena::usedMemory() const
+{
+	return m_verticesAllocator.used() * m_format.layout.stride + m_indicesAllocator.used() * indexSize();
+}
+
+std::size_t BufferArena::capacityMemory() const
+{
+	return m_verticesAllocator.capacity() * m_format.layout.stride + m_indicesAllocator.capacity() * indexSize();
+}
+
+void BufferArena::createBuffers(std::size_t verticesCapacity, std::size_t indicesCapacity)
+{
+	if (verticesCapacity) // If not, the buffers were already created by the caller
+	{
+		m_verticesVBO.reset(createBuffer(verticesCapacity * m_format.layout.stride));
+		m_indicesEBO.reset(createBuffer(indicesCapacity * indexSize()));
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_verticesAllocator.reset(verticesCapacity);
+		m_indicesAllocator.reset(indicesCapacity);
+	}
+
+	if (!m_VAO)
+		m_VAO.create();
+
+	glBindVertexArray(m_VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
+
+	const auto& layout = m_format.layout;
+	const auto stride = static_cast<GLsizei>(layout.stride);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)layout.positionsOffset);
+	glEnableVertexAttribArray(0);
+
+	if (layout.hasNormals)
+	{
+		if (layout.packedNormals)
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)layout.normalsOffset);
+		else
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)layout.normalsOffset);
+		glEnableVertexAttribArray(1);
+	}
+
+	if (layout.hasTexCoords)
+	{
+		switch (layout.texCoordsPacking)
+		{
+		case TexCoordsPacking::Float:	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)layout.texCoordsOffset);				break;
+		case TexCoordsPacking::Unorm16:	glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)layout.texCoordsOffset);		break;
+		case TexCoordsPacking::Half:	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)layout.texCoordsOffset);		break;
+		}
+		glEnableVertexAttribArray(2);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indicesEBO);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void BufferArena::grow(std::size_t nbVertices, std::size_t nbIndices)
+{
+	// Double the capacity of the buffers, or more if needed
+	const auto stride = m_format.layout.stride, idxSize = indexSize();
+	const auto verticesCapacity = m_verticesAllocator.capacity(), indicesCapacity = m_indicesAllocator.capacity();
+	const auto newVerticesCapacity = std::max(verticesCapacity * 2, verticesCapacity + nbVertices);
+	const auto newIndicesCapacity = std::max(indicesCapacity * 2, indicesCapacity + nbIndices);
+
+	BufferHandle newVertices(createBuffer(newVerticesCapacity * stride));
+	glBindBuffer(GL_COPY_READ_BUFFER, m_verticesVBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, verticesCapacity * stride);
+
+	BufferHandle newIndices(createBuffer(newIndicesCapacity * idxSize));
+	glBindBuffer(GL_COPY_READ_BUFFER, m_indicesEBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, indicesCapacity * idxSize);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	m_verticesVBO = std::move(newVertices);
+	m_indicesEBO = std::move(newIndices);
+	m_verticesAllocator.grow(newVerticesCapacity);
+	m_indicesAllocator.grow(newIndicesCapacity);
+	createBuffers(0, 0);
+}
+
+bool operator==(const BufferArena::Format& lhs, const BufferArena::Format& rhs)
+{
+	const auto& l = lhs.layout;
+	const auto& r = rhs.layout;
+	return lhs.shortIndices == rhs.shortIndices
+		&& l.hasPositions == r.hasPositions && l.hasNormals == r.hasNormals && l.hasTexCoords == r.hasTexCoords
+		&& l.packedNormals == r.packedNormals && l.texCoordsPacking == r.texCoordsPacking
+		&& l.stride == r.stride;
+}
+
+//****************************************************************************//
+
+BufferArena& BufferArenas::arena(const BufferArena::Format& format)
+{
+	for (const auto& arena : m_arenas)
+	{
+		if (arena->format() == format)
+			return *arena;
+	}
+
+	m_arenas.push_back(std::make_shared<BufferArena>(format));
+	return *m_arenas.back();
+}
+
+void BufferArenas::defragment()
+{
+	for (const auto& arena : m_arenas)
+	{
+		if (arena->fragmented())
+		{
+			arena->defragment();
+			++m_revision;
+		}
+	}
+}
+
+std::size_t BufferArenas::usedMemory() const
+{
+	std::size_t size = 0;
+	for (const auto& arena : m_arenas)
+		size += arena->usedMemory();
+	return size;
+}
+
+std::size_t BufferArenas::capacityMemory() const
+{
+	std::size_t size = 0;
+	for (const auto& arena : m_arenas)
+		size += arena->capacityMemory();
+	return size;
+}
+
+} // namespace simplerender
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <render/GLResources.h>
+#include <render/VertexPacking.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace simplerender
+{
+
+// Free list over [0, capacity[, in number of elements (first fit, adjacent free ranges are merged)
+class RangeAllocator
+{
+public:
+	static const std::size_t invalid = static_cast<std::size_t>(-1);
+
+	void reset(std::size_t capacity); // Everything is free
+	void grow(std::size_t capacity); // The new elements are free
+	std::size_t allocate(std::size_t size); // Returns the offset of the range, or invalid if no free range is big enough
+	void free(std::size_t offset, std::size_t size);
+
+	std::size_t capacity() const;
+	std::size_t used() const;
+	std::size_t nbFreeRanges() const;
+	bool compact() const; // If the free elements are all at the end
+
+protected:
+	using Range = std::pair<std::size_t, std::size_t>; // Offset, size
+	std::vector<Range> m_freeRanges; // Sorted by offset, never adjacent
+	std::size_t m_capacity = 0, m_used = 0;
+};
+
+class BufferArena;
+
+// Range of a mesh inside an arena, freed when destroyed
+class ArenaAllocation
+{
+public:
+	ArenaAllocation(const std::shared_ptr<BufferArena>& arena, std::size_t baseVertex, std::size_t nbVertices, std::size_t firstIndex, std::size_t nbIndices);
+	~ArenaAllocation();
+
+	BufferArena& arena() const;
+
+	std::size_t baseVertex, nbVertices; // In vertices
+	std::size_t firstIndex, nbIndices; // In indices
+
+protected:
+	std::shared_ptr<BufferArena> m_arena;
+};
+
+// A vertex buffer and an index buffer shared by meshes using the same vertex format, with one VAO
+// The buffers grow when needed, and can be compacted when meshes are removed
+class BufferArena : public std::enable_shared_from_this<BufferArena>
+{
+public:
+	struct Format
+	{
+		InterleavedLayout layout; // Must contain the positions
+		bool shortIndices = false;
+	};
+
+	BufferArena(const Format& format);
+
+	std::shared_ptr<ArenaAllocation> allocate(std::size_t nbVertices, std::size_t nbIndices); // Needs an OpenGL context
+	void upload(const ArenaAllocation& allocation, const void* vertices, const void* indices); // Complete vertices (with the stride of the format) and indices
+
+	void defragment(); // Moves the allocations to the beginning of new buffers, if the free space is not all at the end
+	bool fragmented() const;
+
+	unsigned int vao() const;
+	const Format& format() const;
+	std::size_t indexSize() const; // In bytes
+	std::size_t usedMemory() const;
+	std::size_t capacityMemory() const;
+
+protected:
+	friend class ArenaAllocation;
+	void free(ArenaAllocation& allocation);
+
+	void createBuffers(std::size_t verticesCapacity, std::size_t indicesCapacity); // Creates new buffers (if the capacities are not 0) and points the VAO to them
+	void grow(std::size_t nbVertices, std::size_t nbIndices); // So that both can be allocated
+
+	Format m_format;
+	RangeAllocator m_verticesAllocator, m_indicesAllocator;
+	VertexArrayHandle m_VAO;
+	BufferHandle m_verticesVBO, m_indicesEBO;
+	std::vector<ArenaAllocation*> m_allocations; // Live ranges, updated by defragment
+};
+
+bool operator==(const BufferArena::Format& lhs, const BufferArena::Format& rhs);
+
+// The arenas of a scene, one for each vertex format
+class BufferArenas
+{
+public:
+	using SPtr = std::shared_ptr<BufferArenas>;
+
+	BufferArena& arena(const BufferArena::Format& format); // Created if needed
+	void defragment(); // Of every fragmented arena, to call on the OpenGL thread
+
+	unsigned int revision() const; // Incremented each time allocations are moved by defragment
+	std::size_t usedMemory() const;
+	std::size_t capacityMemory() const;
+
+protected:
+	std::vector<std::shared_ptr<BufferArena>> m_arenas;
+	unsigned int m_revision = 0;
+};
+
+//****************************************************************************//
+
+inline std::size_t RangeAllocator::capacity() const
+{ return m_capacity; }
+
+inline std::size_t RangeAllocator::used() const
+{ return m_used; }
+
+inline std::size_t RangeAllocator::nbFreeRanges() const
+{ return m_freeRanges.size(); }
+
+inline BufferArena& ArenaAllocation::arena() const
+{ return *m_arena; }
+
+inline unsigned int BufferArena::vao() const
+{ return m_VAO.id(); }
+
+inline const BufferArena::Format& BufferArena::format() const
+{ return m_format; }
+
+inline unsigned int BufferArenas::revision() const
+{ return m_revision; }
+
+} // namespace simplerender
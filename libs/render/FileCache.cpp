@@ -0,0 +1,158 @@
+#include <render/FileCache.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
+
+namespace
+{
+
+struct CacheFile
+{
+	std::string path;
+	std::uint64_t size = 0;
+	std::int64_t modification = 0;
+};
+
+// The files "prefix_*.bin" of the directory (not the ones being written)
+std::vector<CacheFile> listCacheFiles(const std::string& directory, const std::string& prefix)
+{
+	std::vector<CacheFile> files;
+	const auto start = prefix + "_";
+	const std::string extension = ".bin";
+	auto add = [&](const std::string& name) {
+		if (name.size() <= start.size() + extension.size() || name.compare(0, start.size(), start)
+			|| name.compare(name.size() - extension.size(), extension.size(), extension))
+			return;
+
+		CacheFile file;
+		file.path = directory + "/" + name;
+		struct stat info;
+		if (stat(file.path.c_str(), &info))
+			return;
+
+		file.size = info.st_size;
+		file.modification = info.st_mtime;
+		files.push_back(file);
+	};
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	const auto handle = FindFirstFileA((directory + "/" + start + "*" + extension).c_str(), &data);
+	if (handle == INVALID_HANDLE_VALUE)
+		return files;
+	do
+		add(data.cFileName);
+	while (FindNextFileA(handle, &data));
+	FindClose(handle);
+#else
+	const auto dir = opendir(directory.c_str());
+	if (!dir)
+		return files;
+	while (const auto entry = readdir(dir))
+		add(entry->d_name);
+	closedir(dir);
+#endif
+
+	return files;
+}
+
+}
+
+namespace simplerender
+{
+
+std::uint64_t hashData(const void* data, std::size_t size, std::uint64_t hash)
+{
+	auto bytes = static_cast<const unsigned char*>(data);
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string cacheFilePath(const std::string& directory, const std::string& prefix, std::uint64_t key)
+{
+	std::ostringstream path;
+	path << directory << "/" << prefix << "_" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return path.str();
+}
+
+bool writeFileAtomically(const std::string& path, const WriteFileFunc& write)
+{
+	const auto tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		if (!write(file) || !file)
+		{
+			file.close();
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(tmpPath.c_str(), path.c_str()))
+	{
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+void trimCacheFiles(const std::string& directory, const std::string& prefix, std::uint64_t maxSize)
+{
+	static std::mutex mutex; // Files can be saved by multiple threads
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto files = listCacheFiles(directory, prefix);
+	std::uint64_t total = 0;
+	for (const auto& file : files)
+		total += file.size;
+	if (total <= maxSize)
+		return;
+
+	std::sort(files.begin(), files.end(), [](const CacheFile& lhs, const CacheFile& rhs) {
+		return lhs.modification < rhs.modification;
+	});
+
+	for (const auto& file : files)
+	{
+		if (total <= maxSize)
+			break;
+
+		if (!std::remove(file.path.c_str())) // Fails on Windows if the file is mapped, it is then kept
+			total -= file.size;
+	}
+}
+
+void touchFile(const std::string& path)
+{
+	utime(path.c_str(), nullptr);
+}
+
+} // namespace simplerender
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace simplerender
+{
+
+// Helpers for the files of the caches on disk (the program binaries and the decoded textures)
+
+const std::uint64_t fnvOffset = 14695981039346656037ull; // Initial value of the hashes
+
+// FNV-1a, stable between runs and compilers. Chain the calls by passing the previous result
+std::uint64_t hashData(const void* data, std::size_t size, std::uint64_t hash = fnvOffset);
+
+// "directory/prefix_0123456789abcdef.bin"
+std::string cacheFilePath(const std::string& directory, const std::string& prefix, std::uint64_t key);
+
+// The file is written under another name then renamed, so that an interrupted write is never read
+// The function returns false if the contents are incomplete, then the file is not created
+using WriteFileFunc = std::function<bool(std::ostream& out)>;
+bool writeFileAtomically(const std::string& path, const WriteFileFunc& write);
+
+// Removes the least recently used files "directory/prefix_*.bin" until their total size is under maxSize
+// The files read from the cache must be touched to be seen as used (their modification time is compared)
+void trimCacheFiles(const std::string& directory, const std::string& prefix, std::uint64_t maxSize);
+void touchFile(const std::string& path); // Sets its modification time to now
+
+} // namespace simplerender
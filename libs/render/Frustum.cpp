@@ -0,0 +1,44 @@
+#include <render/Frustum.h>
+
+namespace simplerender
+{
+
+Frustum::Frustum(const glm::mat4& m)
+{
+	// Rows of the matrix (glm is column major)
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+	m_planes[0] = rows[3] + rows[0]; // Left
+	m_planes[1] = rows[3] - rows[0]; // Right
+	m_planes[2] = rows[3] + rows[1]; // Bottom
+	m_planes[3] = rows[3] - rows[1]; // Top
+	m_planes[4] = rows[3] + rows[2]; // Near
+	m_planes[5] = rows[3] - rows[2]; // Far
+}
+
+Frustum::Intersection Frustum::test(const glm::vec3& min, const glm::vec3& max) const
+{
+	auto result = Intersection::Inside;
+	for (const auto& plane : m_planes)
+	{
+		// The corner the most in the direction of the normal, and the opposite one
+		glm::vec3 positive, negative;
+		for (int i = 0; i < 3; ++i)
+		{
+			positive[i] = plane[i] >= 0 ? max[i] : min[i];
+			negative[i] = plane[i] >= 0 ? min[i] : max[i];
+		}
+
+		const glm::vec3 normal(plane.x, plane.y, plane.z);
+		if (glm::dot(normal, positive) + plane.w < 0)
+			return Intersection::Outside;
+		if (glm::dot(normal, negative) + plane.w < 0)
+			result = Intersection::Intersects;
+	}
+
+	return result;
+}
+
+} // namespace simplerender
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <utility>
+
+namespace simplerender
+{
+
+class Frustum
+{
+public:
+	enum class Intersection { Outside, Intersects, Inside };
+
+	Frustum() = default;
+	Frustum(const glm::mat4& viewProjection); // Extracts the 6 planes of the matrix
+
+	Intersection test(const glm::vec3& min, const glm::vec3& max) const;
+	Intersection test(const std::pair<glm::vec3, glm::vec3>& box) const;
+
+protected:
+	std::array<glm::vec4, 6> m_planes; // Normals pointing inside
+};
+
+//****************************************************************************//
+
+inline Frustum::Intersection Frustum::test(const std::pair<glm::vec3, glm::vec3>& box) const
+{ return test(box.first, box.second); }
+
+} // namespace simplerender
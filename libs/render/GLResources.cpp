@@ -0,0 +1,138 @@
+#include <render/GLResources.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using simplerender::GLResourceType;
+
+const int nbResourceTypes = 4;
+
+std::atomic<int> liveCounters[nbResourceTypes] = {};
+
+struct ReleasedResources
+{
+	std::mutex mutex;
+	std::vector<std::pair<GLResourceType, unsigned int>> objects;
+	std::vector<void*> syncs;
+};
+
+ReleasedResources& releasedResources()
+{
+	static ReleasedResources released;
+	return released;
+}
+
+std::atomic<int>& liveCounter(GLResourceType type)
+{
+	return liveCounters[static_cast<int>(type)];
+}
+
+}
+
+namespace simplerender
+{
+
+unsigned int createGLResource(GLResourceType type)
+{
+	GLuint id = 0;
+	switch (type)
+	{
+	case GLResourceType::Buffer:		glGenBuffers(1, &id);			break;
+	case GLResourceType::VertexArray:	glGenVertexArrays(1, &id);		break;
+	case GLResourceType::Texture:		glGenTextures(1, &id);			break;
+	case GLResourceType::Program:		id = glCreateProgram();			break;
+	}
+
+	return id; // Counted when a handle takes it
+}
+
+void adoptGLResource(GLResourceType type, unsigned int id)
+{
+	if (id)
+		++liveCounter(type);
+}
+
+void releaseGLResource(GLResourceType type, unsigned int id)
+{
+	if (!id)
+		return;
+
+	auto& released = releasedResources();
+	std::lock_guard<std::mutex> lock(released.mutex);
+	released.objects.emplace_back(type, id);
+}
+
+void releaseGLSync(void* sync)
+{
+	if (!sync)
+		return;
+
+	auto& released = releasedResources();
+	std::lock_guard<std::mutex> lock(released.mutex);
+	released.syncs.push_back(sync);
+}
+
+void deleteReleasedGLResources()
+{
+	// Take the lists, so that the lock is not held during the OpenGL calls
+	std::vector<std::pair<GLResourceType, unsigned int>> objects;
+	std::vector<void*> syncs;
+	{
+		auto& released = releasedResources();
+		std::lock_guard<std::mutex> lock(released.mutex);
+		objects.swap(released.objects);
+		syncs.swap(released.syncs);
+	}
+
+	for (const auto& object : objects)
+	{
+		const GLuint id = object.second;
+		switch (object.first)
+		{
+		case GLResourceType::Buffer:		glDeleteBuffers(1, &id);			break;
+		case GLResourceType::VertexArray:	glDeleteVertexArrays(1, &id);		break;
+		case GLResourceType::Texture:		glDeleteTextures(1, &id);			break;
+		case GLResourceType::Program:		glDeleteProgram(id);				break;
+		}
+
+		--liveCounter(object.first);
+	}
+
+	for (auto sync : syncs)
+		glDeleteSync(static_cast<GLsync>(sync));
+}
+
+GLResourcesCounters glResourcesCounters()
+{
+	GLResourcesCounters counters;
+	counters.buffers = liveCounter(GLResourceType::Buffer);
+	counters.vertexArrays = liveCounter(GLResourceType::VertexArray);
+	counters.textures = liveCounter(GLResourceType::Texture);
+	counters.programs = liveCounter(GLResourceType::Program);
+
+	auto& released = releasedResources();
+	std::lock_guard<std::mutex> lock(released.mutex);
+	counters.pendingDeletions = static_cast<unsigned int>(released.objects.size() + released.syncs.size());
+	return counters;
+}
+
+std::string statusText(const GLResourcesCounters& counters)
+{
+	std::ostringstream text;
+	text << "GL: " << counters.buffers << " buffers, " << counters.vertexArrays << " VAOs, "
+		<< counters.textures << " textures, " << counters.programs << " programs";
+	if (counters.pendingDeletions)
+		text << " (" << counters.pendingDeletions << " released)";
+	return text.str();
+}
+
+} // namespace simplerender
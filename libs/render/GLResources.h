@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+
+namespace simplerender
+{
+
+enum class GLResourceType
+{
+	Buffer,
+	VertexArray,
+	Texture,
+	Program
+};
+
+// Number of OpenGL objects taken by handles and not yet deleted, to track leaks
+struct GLResourcesCounters
+{
+	unsigned int buffers = 0, vertexArrays = 0, textures = 0, programs = 0;
+	unsigned int pendingDeletions = 0; // Released, waiting for deleteReleasedGLResources (syncs included)
+};
+
+// The objects can be released from any thread, they are deleted later on the OpenGL thread
+unsigned int createGLResource(GLResourceType type); // Needs an OpenGL context
+void adoptGLResource(GLResourceType type, unsigned int id); // Counts an object created outside of createGLResource
+void releaseGLResource(GLResourceType type, unsigned int id); // Queues its deletion
+void releaseGLSync(void* sync); // Same for a GLsync
+void deleteReleasedGLResources(); // Must be called with the OpenGL context current (done at the beginning of Scene::render)
+GLResourcesCounters glResourcesCounters();
+std::string statusText(const GLResourcesCounters& counters); // For the status bar
+
+// Owns an OpenGL object, released when the handle is destroyed or reset
+// A copy does not share the object, it is empty (so that a copied mesh creates its own buffers)
+template <GLResourceType Type>
+class GLHandle
+{
+public:
+	GLHandle() = default;
+	explicit GLHandle(unsigned int id); // Takes the ownership of the object
+	~GLHandle();
+
+	GLHandle(const GLHandle&);
+	GLHandle& operator=(const GLHandle& other);
+	GLHandle(GLHandle&& other);
+	GLHandle& operator=(GLHandle&& other);
+
+	void create(); // Replaces the current object by a new one
+	void reset(unsigned int id = 0); // Releases the current object and takes the ownership of the new one
+	unsigned int id() const;
+	operator unsigned int() const;
+
+protected:
+	unsigned int m_id = 0;
+};
+
+using BufferHandle = GLHandle<GLResourceType::Buffer>;
+using VertexArrayHandle = GLHandle<GLResourceType::VertexArray>;
+using TextureHandle = GLHandle<GLResourceType::Texture>;
+using ProgramHandle = GLHandle<GLResourceType::Program>;
+
+//****************************************************************************//
+
+template <GLResourceType Type>
+GLHandle<Type>::GLHandle(unsigned int id)
+{ reset(id); }
+
+template <GLResourceType Type>
+GLHandle<Type>::~GLHandle()
+{ reset(); }
+
+template <GLResourceType Type>
+GLHandle<Type>::GLHandle(const GLHandle&)
+{ }
+
+template <GLResourceType Type>
+GLHandle<Type>& GLHandle<Type>::operator=(const GLHandle& other)
+{
+	if (this != &other)
+		reset();
+	return *this;
+}
+
+template <GLResourceType Type>
+GLHandle<Type>::GLHandle(GLHandle&& other)
+	: m_id(other.m_id)
+{ other.m_id = 0; }
+
+template <GLResourceType Type>
+GLHandle<Type>& GLHandle<Type>::operator=(GLHandle&& other)
+{
+	if (this != &other)
+	{
+		reset();
+		m_id = other.m_id;
+		other.m_id = 0;
+	}
+	return *this;
+}
+
+template <GLResourceType Type>
+void GLHandle<Type>::create()
+{ reset(createGLResource(Type)); } // Counted by reset
+
+template <GLResourceType Type>
+void GLHandle<Type>::reset(unsigned int id)
+{
+	if (m_id)
+		releaseGLResource(Type, m_id);
+	m_id = id;
+	if (m_id)
+		adoptGLResource(Type, m_id);
+}
+
+template <GLResourceType Type>
+inline unsigned int GLHandle<Type>::id() const
+{ return m_id; }
+
+template <GLResourceType Type>
+inline GLHandle<Type>::operator unsigned int() const
+{ return m_id; }
+
+} // namespace simplerender
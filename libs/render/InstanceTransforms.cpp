@@ -0,0 +1,57 @@
+#include <render/InstanceTransforms.h>
+
+namespace simplerender
+{
+
+const InstanceTransforms::Index InstanceTransforms::invalid;
+
+InstanceTransforms::Index InstanceTransforms::add(const glm::mat4& transformation)
+{
+	Index index;
+	if (!m_freeSlots.empty())
+	{
+		index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		index = static_cast<Index>(m_transformations.size());
+		m_transformations.emplace_back();
+		m_modified.push_back(0);
+	}
+
+	m_transformations[index] = transformation;
+	return index;
+}
+
+void InstanceTransforms::remove(Index index)
+{
+	m_freeSlots.push_back(index);
+}
+
+void InstanceTransforms::set(Index index, const glm::mat4& transformation)
+{
+	m_transformations[index] = transformation;
+	if (m_modified[index])
+		return;
+
+	m_modified[index] = 1;
+	m_modifiedSlots.push_back(index);
+}
+
+void InstanceTransforms::takeModified(Indices& modified)
+{
+	for (auto index : m_modifiedSlots)
+		m_modified[index] = 0;
+	modified.clear();
+	modified.swap(m_modifiedSlots);
+}
+
+void InstanceTransforms::clearModified()
+{
+	for (auto index : m_modifiedSlots)
+		m_modified[index] = 0;
+	m_modifiedSlots.clear();
+}
+
+} // namespace simplerender
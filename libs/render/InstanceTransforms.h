@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace simplerender
+{
+
+// Transformations of the instances of a scene, stored contiguously behind stable indices
+// The instances write in their slot, and the scene only reads the slots modified since its last update
+class InstanceTransforms
+{
+public:
+	using SPtr = std::shared_ptr<InstanceTransforms>;
+	using Index = unsigned int;
+	using Indices = std::vector<Index>;
+	static const Index invalid = static_cast<Index>(-1);
+
+	Index add(const glm::mat4& transformation); // May reuse the slot of a removed one
+	void remove(Index index);
+
+	void set(Index index, const glm::mat4& transformation); // Marks the slot as modified
+	const glm::mat4& get(Index index) const;
+	std::size_t size() const; // Number of slots, including the free ones
+
+	void takeModified(Indices& modified); // Swaps with the list of the slots modified since the last call
+	void clearModified();
+
+protected:
+	std::vector<glm::mat4> m_transformations;
+	std::vector<char> m_modified;
+	Indices m_modifiedSlots, m_freeSlots;
+};
+
+//****************************************************************************//
+
+inline const glm::mat4& InstanceTransforms::get(Index index) const
+{ return m_transformations[index]; }
+
+inline std::size_t InstanceTransforms::size() const
+{ return m_transformations.size(); }
+
+} // namespace simplerender
@@ -1,5 +1,6 @@
 #include <render/Material.h>
 #include <render/Texture.h>
+#include <render/TextureCache.h>
 
 namespace simplerender
 {
@@ -27,15 +28,12 @@ TextureType getTextureType(const std::string& name)
 
 void Material::init()
 {
+	++m_revision;
 	for (auto& tex : textures)
 	{
 		auto& texture = tex.texture;
-		if (!tex.filePath.empty())
-		{
-			texture = std::make_shared<Texture>();
-			if (!texture->loadFromFile(tex.filePath))
-				texture.reset();
-		}
+		if (!tex.filePath.empty()) // Shared with the other materials using the same file, decoded in the background
+			texture = TextureCache::instance().fromFile(tex.filePath);
 
 		if (texture)
 			texture->init();
@@ -43,6 +41,12 @@ void Material::init()
 }
 
 unsigned int Material::textureId(TextureType type, int id) const
+{
+	const auto tex = texture(type, id);
+	return tex ? tex->id() : 0;
+}
+
+std::shared_ptr<Texture> Material::texture(TextureType type, int id) const
 {
 	int i = 0;
 	auto typeVal = static_cast<unsigned int>(type);
@@ -51,12 +55,12 @@ unsigned int Material::textureId(TextureType type, int id) const
 		if (tex.type == typeVal)
 		{
 			if (i == id)
-				return tex.texture ? tex.texture->id() : 0;
+				return tex.texture;
 			++i;
 		}
 	}
 
-	return 0;
+	return nullptr;
 }
 
 } // namespace simplerender
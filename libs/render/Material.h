@@ -39,6 +39,8 @@ public:
 
 	void init(); // Mainly to load the texture
 	unsigned int textureId(TextureType type, int id) const;
+	std::shared_ptr<Texture> texture(TextureType type, int id) const; // Null if there is none
+	unsigned int revision() const; // Incremented each time the material is initialized
 
 	Color diffuse = { 0.75f, 0.75f, 0.75f, 1.0f };
 	Color ambient = { 0.2f, 0.2f, 0.2f, 1.0f };
@@ -46,6 +48,14 @@ public:
 	Color emissive = { 0.0f, 0.0f, 0.0f, 0.0f };
 	float shininess = 45.0f;
 	std::vector<TextureData> textures;
+
+protected:
+	unsigned int m_revision = 0;
 };
 
+//****************************************************************************//
+
+inline unsigned int Material::revision() const
+{ return m_revision; }
+
 } // namespace simplerender
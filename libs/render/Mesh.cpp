@@ -1,75 +1,401 @@
 #include <render/Mesh.h>
+#include <render/MeshOptimization.h>
 #include <render/Texture.h>
+#include <render/VertexKernels.h>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+
+namespace
+{
+
+const unsigned int rangesMergeGap = 64; // Uploading a few unchanged vertices is cheaper than doing another call
+
+// Create the storage of the buffer currently bound to target
+// Static meshes are uploaded now in an immutable storage (if supported), the others will be filled later
+void createStorage(GLenum target, std::size_t size, const void* data, simplerender::StorageMode mode)
+{
+	if (mode != simplerender::StorageMode::Static)
+		glBufferData(target, size, nullptr, GL_DYNAMIC_DRAW);
+	else if (GLEW_ARB_buffer_storage && size)
+		glBufferStorage(target, size, data, 0);
+	else
+		glBufferData(target, size, data, GL_STATIC_DRAW);
+}
+
+const std::size_t maxShortIndices = 65536; // Meshes with more vertices need 32 bits indices
+
+// Returns the indices as GLushort (converted in shortIndices) or GLuint, and their size in bytes
+template <class T>
+std::pair<const void*, std::size_t> indicesData(const std::vector<T>& primitives, bool useShort, std::vector<GLushort>& shortIndices)
+{
+	const std::size_t nb = primitives.size() * std::tuple_size<T>::value;
+	if (!useShort)
+		return std::make_pair(static_cast<const void*>(primitives.data()), nb * sizeof(GLuint));
+
+	shortIndices.clear();
+	shortIndices.reserve(nb);
+	for (const auto& primitive : primitives)
+	{
+		for (auto index : primitive)
+			shortIndices.push_back(static_cast<GLushort>(index));
+	}
+
+	return std::make_pair(static_cast<const void*>(shortIndices.data()), nb * sizeof(GLushort));
+}
+
+// Returns the texture coordinates in the given format (converted in packed if needed), and their size in bytes
+std::pair<const void*, std::size_t> texCoordsData(const simplerender::TexCoords& texCoords, simplerender::TexCoordsPacking packing, std::vector<std::uint16_t>& packed)
+{
+	const auto size = simplerender::texCoordSize(packing) * texCoords.size();
+	if (packing == simplerender::TexCoordsPacking::Float)
+		return std::make_pair(static_cast<const void*>(texCoords.data()), size);
+
+	packed = simplerender::packTexCoords(texCoords, packing);
+	return std::make_pair(static_cast<const void*>(packed.data()), size);
+}
+
+}
+
 namespace simplerender
 {
 
+Mesh::Mesh(const Mesh& other)
+	: m_vertices(other.m_vertices)
+	, m_normals(other.m_normals)
+	, m_edges(other.m_edges)
+	, m_triangles(other.m_triangles)
+	, m_quads(other.m_quads)
+	, m_texCoords(other.m_texCoords)
+	, m_mergedTriangles(other.m_mergedTriangles)
+	, m_storageMode(other.m_storageMode)
+	, m_attributesFormat(other.m_attributesFormat)
+	, m_vertexLayout(other.m_vertexLayout)
+	, m_bufferArenas(other.m_bufferArenas)
+	, m_indicesOptimization(other.m_indicesOptimization)
+	, m_detectChanges(other.m_detectChanges)
+{
+	// Not the buffers, the fences, the mapping nor the arena allocation, which are owned by the original
+	// Nor the levels of detail, which can be replaced at any time by the generator
+}
+
+Mesh::~Mesh()
+{
+	releaseFences(); // The buffers are released by their handles
+}
+
 void Mesh::init()
 {
 	mergeIndices();
+	if (m_storageMode == StorageMode::Static) // The others can be modified by index afterwards
+		optimizeIndices();
 	prepareBuffers();
-	updateIndices();
-	updatePositions();
+	if (m_storageMode != StorageMode::Static) // Static meshes are uploaded in prepareBuffers
+	{
+		updateIndices();
+		updatePositions();
+	}
 	initTexture();
 }
 
 void Mesh::prepareBuffers()
 {
 	auto vertSize = m_vertices.size();
+	++m_revision;
+	++m_positionsRevision;
+	m_boundsValid = false;
 
-	glGenVertexArrays(1, &m_VAO);
-	glBindVertexArray(m_VAO);
+	// Everything will be uploaded
+	m_dirtyRanges.clear();
+	m_uploadedVertices.clear();
+	m_uploadedNormals.clear();
 
-	// Vertices
-	glGenBuffers(1, &m_verticesVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
-	glBufferData(GL_ARRAY_BUFFER, 3 * sizeof(float) * vertSize, nullptr, GL_DYNAMIC_DRAW);
+	// If the mesh has triangles, it needs normals
+	if (!m_mergedTriangles.empty() && m_normals.empty())
+		m_normals.resize(vertSize);
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-	glEnableVertexAttribArray(0);
+	// Choose the formats of the buffers
+	const bool compact = (m_attributesFormat == AttributesFormat::Compact);
+	m_shortIndices = compact && vertSize <= maxShortIndices;
+	m_packedNormals = compact && m_storageMode != StorageMode::Streaming; // The streaming buffer is written directly from the vertices and normals
+	m_texCoordsPacking = compact ? selectTexCoordsPacking(m_texCoords) : TexCoordsPacking::Float;
+	m_buffersMemory = BuffersMemory();
 
-	// If the mesh has triangles
-	if (!m_mergedTriangles.empty())
+	// Release the previous buffers (or the range in the arena)
+	m_VAO.reset();
+	m_verticesVBO.reset();
+	m_normalsVBO.reset();
+	m_texCoordsVBO.reset();
+	m_indicesEBO.reset();
+	m_arenaAllocation.reset();
+
+	const bool validTexCoords = (m_texCoords.empty() || m_texCoords.size() == vertSize);
+	if (m_bufferArenas && m_storageMode == StorageMode::Static && !m_mergedTriangles.empty() && validTexCoords)
 	{
-		// Normals
-		if (m_normals.empty())
-			m_normals.resize(vertSize);
+		prepareArenaBuffers();
+		return;
+	}
 
-		glGenBuffers(1, &m_normalsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, m_normalsVBO);
-		glBufferData(GL_ARRAY_BUFFER, 3 * sizeof(float) * vertSize, nullptr, GL_DYNAMIC_DRAW);
+	m_VAO.create();
+	glBindVertexArray(m_VAO);
 
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-		glEnableVertexAttribArray(1);
+	m_interleaved = (m_vertexLayout == VertexLayout::Interleaved && m_storageMode != StorageMode::Streaming);
+	if (m_storageMode == StorageMode::Streaming)
+	{
+		prepareStreamingBuffer();
+		m_buffersMemory.used = m_buffersMemory.full = m_streaming.regionSize * m_streaming.nbRegions;
+	}
+	else if (m_interleaved)
+		prepareInterleavedBuffers();
+	else
+	{
+		// Vertices
+		const auto verticesSize = 3 * sizeof(float) * vertSize;
+		m_verticesVBO.create();
+		glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
+		createStorage(GL_ARRAY_BUFFER, verticesSize, m_vertices.data(), m_storageMode);
+		m_buffersMemory.used += verticesSize;
+		m_buffersMemory.full += verticesSize;
 
-		// Texture coordinates
-		if (!m_texCoords.empty())
-		{
-			glGenBuffers(1, &m_texCoordsVBO);
-			glBindBuffer(GL_ARRAY_BUFFER, m_texCoordsVBO);
-			glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(float) * m_texCoords.size(), nullptr, GL_DYNAMIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+		glEnableVertexAttribArray(0);
 
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-			glEnableVertexAttribArray(2);
+		// Normals
+		if (!m_mergedTriangles.empty())
+		{
+			m_normalsVBO.create();
+			glBindBuffer(GL_ARRAY_BUFFER, m_normalsVBO);
+			if (m_packedNormals)
+			{
+				std::vector<std::uint32_t> packed(vertSize);
+				packNormals(m_normals.data(), vertSize, packed.data());
+				createStorage(GL_ARRAY_BUFFER, sizeof(std::uint32_t) * vertSize, packed.data(), m_storageMode);
+				m_buffersMemory.used += sizeof(std::uint32_t) * vertSize;
+			}
+			else
+			{
+				createStorage(GL_ARRAY_BUFFER, 3 * sizeof(float) * vertSize, m_normals.data(), m_storageMode);
+				m_buffersMemory.used += 3 * sizeof(float) * vertSize;
+			}
+			setNormalsPointer(0, 0);
+			glEnableVertexAttribArray(1);
+			m_buffersMemory.full += 3 * sizeof(float) * vertSize;
 		}
 	}
 
+	// Texture coordinates
+	if (!m_mergedTriangles.empty() && !m_texCoords.empty() && !(m_interleaved && m_interleavedLayout.hasTexCoords))
+	{
+		std::vector<std::uint16_t> packed;
+		const auto texCoords = texCoordsData(m_texCoords, m_texCoordsPacking, packed);
+		m_texCoordsVBO.create();
+		glBindBuffer(GL_ARRAY_BUFFER, m_texCoordsVBO);
+		createStorage(GL_ARRAY_BUFFER, texCoords.second, texCoords.first, m_storageMode);
+		setTexCoordsPointer(0, 0);
+		glEnableVertexAttribArray(2);
+		m_buffersMemory.used += texCoords.second;
+		m_buffersMemory.full += 2 * sizeof(float) * m_texCoords.size();
+	}
+
 	// Indices
-	glGenBuffers(1, &m_indicesEBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indicesEBO);
+	std::vector<GLushort> shortIndices;
+	std::pair<const void*, std::size_t> indices(nullptr, 0);
 	if (!m_mergedTriangles.empty())
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_mergedTriangles.size() * 3 * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+		indices = indicesData(m_mergedTriangles, m_shortIndices, shortIndices);
 	else if (!m_edges.empty())
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_edges.size() * 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+		indices = indicesData(m_edges, m_shortIndices, shortIndices);
+
+	m_indicesEBO.create();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indicesEBO);
+	if (indices.second)
+		createStorage(GL_ELEMENT_ARRAY_BUFFER, indices.second, indices.first, m_storageMode);
+	m_buffersMemory.used += indices.second;
+	m_buffersMemory.full += m_shortIndices ? indices.second * 2 : indices.second;
 
 	glBindVertexArray(0); // Unbind the VAO
 }
 
+void Mesh::prepareInterleavedBuffers()
+{
+	const auto vertSize = m_vertices.size();
+	const bool hasNormals = !m_mergedTriangles.empty();
+	const bool hasTexCoords = hasNormals && m_texCoords.size() == vertSize; // If not, they are in their own buffer
+	const bool separatePositions = (m_storageMode != StorageMode::Static); // So that they can be updated alone
+
+	m_interleavedLayout = interleavedLayout(!separatePositions, hasNormals, m_packedNormals, hasTexCoords, m_texCoordsPacking);
+	const auto& layout = m_interleavedLayout;
+
+	if (separatePositions)
+	{
+		const auto verticesSize = 3 * sizeof(float) * vertSize;
+		m_verticesVBO.create();
+		glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
+		createStorage(GL_ARRAY_BUFFER, verticesSize, m_vertices.data(), m_storageMode);
+		m_buffersMemory.used += verticesSize;
+		m_buffersMemory.full += verticesSize;
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+
+		if (!layout.stride)
+			return;
+	}
+
+	// The interleaved vertices are created once, the dynamic meshes only update the modified ranges later
+	std::vector<unsigned char> data(layout.stride * vertSize);
+	interleave(layout, m_vertices.data(), m_normals.data(), m_texCoords.data(), 0, vertSize, data.data());
+
+	auto& vbo = separatePositions ? m_normalsVBO : m_verticesVBO;
+	vbo.create();
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	if (m_storageMode == StorageMode::Static)
+		createStorage(GL_ARRAY_BUFFER, data.size(), data.data(), m_storageMode);
+	else
+		glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_DYNAMIC_DRAW);
+
+	if (layout.hasPositions)
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, layout.stride, (GLvoid*)layout.positionsOffset);
+		glEnableVertexAttribArray(0);
+		m_buffersMemory.full += 3 * sizeof(float) * vertSize;
+	}
+
+	if (layout.hasNormals)
+	{
+		setNormalsPointer(layout.stride, layout.normalsOffset);
+		glEnableVertexAttribArray(1);
+		m_buffersMemory.full += 3 * sizeof(float) * vertSize;
+	}
+
+	if (layout.hasTexCoords)
+	{
+		setTexCoordsPointer(layout.stride, layout.texCoordsOffset);
+		glEnableVertexAttribArray(2);
+		m_buffersMemory.full += 2 * sizeof(float) * vertSize;
+	}
+
+	m_buffersMemory.used += data.size();
+}
+
+void Mesh::prepareArenaBuffers()
+{
+	const auto vertSize = m_vertices.size();
+	BufferArena::Format format;
+	format.layout = interleavedLayout(true, true, m_packedNormals, !m_texCoords.empty(), m_texCoordsPacking);
+	format.shortIndices = m_shortIndices;
+	const auto& layout = format.layout;
+
+	std::vector<unsigned char> vertices(layout.stride * vertSize);
+	interleave(layout, m_vertices.data(), m_normals.data(), m_texCoords.data(), 0, vertSize, vertices.data());
+
+	std::vector<GLushort> shortIndices;
+	const auto indices = indicesData(m_mergedTriangles, m_shortIndices, shortIndices);
+
+	auto& arena = m_bufferArenas->arena(format);
+	m_arenaAllocation = arena.allocate(vertSize, m_mergedTriangles.size() * 3);
+	arena.upload(*m_arenaAllocation, vertices.data(), indices.first);
+
+	m_buffersMemory.used = vertices.size() + indices.second;
+	m_buffersMemory.full = vertSize * (layout.hasTexCoords ? 8 : 6) * sizeof(float) + m_mergedTriangles.size() * 3 * sizeof(GLuint);
+}
+
+unsigned int Mesh::vertexArray() const
+{
+	return m_arenaAllocation ? m_arenaAllocation->arena().vao() : m_VAO.id();
+}
+
+void Mesh::setNormalsPointer(std::size_t stride, std::size_t offset)
+{
+	// Packed normals are decoded by the vertex fetch, the shaders still get a vec3
+	if (m_packedNormals)
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)offset);
+	else
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offset);
+}
+
+void Mesh::setTexCoordsPointer(std::size_t stride, std::size_t offset)
+{
+	switch (m_texCoordsPacking)
+	{
+	case TexCoordsPacking::Float:	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offset);				break;
+	case TexCoordsPacking::Unorm16:	glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offset);		break;
+	case TexCoordsPacking::Half:	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)offset);		break;
+	}
+}
+
+void Mesh::uploadInterleaved(unsigned int first, unsigned int count)
+{
+	const auto& layout = m_interleavedLayout;
+	std::vector<unsigned char> data(layout.stride * count);
+	interleave(layout, m_vertices.data(), m_normals.data(), m_texCoords.data(), first, count, data.data());
+	glBufferSubData(GL_ARRAY_BUFFER, layout.stride * first, data.size(), data.data());
+}
+
+void Mesh::prepareStreamingBuffer()
+{
+	// Each region contains all the positions, followed by all the normals
+	auto& stream = m_streaming;
+	stream.nbVertices = static_cast<unsigned int>(m_vertices.size());
+	stream.hasNormals = !m_mergedTriangles.empty();
+	stream.normalsOffset = 3 * sizeof(float) * stream.nbVertices;
+	stream.regionSize = stream.normalsOffset * (stream.hasNormals ? 2 : 1);
+	stream.nbRegions = GLEW_ARB_buffer_storage ? streamingRegions : 1;
+	stream.region = 0;
+	stream.mapping = nullptr; // Unmapped when the previous buffer is deleted
+	releaseFences();
+
+	m_verticesVBO.create();
+	glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
+	const auto size = stream.regionSize * stream.nbRegions;
+	if (GLEW_ARB_buffer_storage && size)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+		stream.mapping = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	}
+
+	if (!stream.mapping) // Fallback using orphaning
+	{
+		stream.nbRegions = 1;
+		glBufferData(GL_ARRAY_BUFFER, stream.regionSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	// Every region must be completely written the first time
+	for (auto& pending : stream.pendingRanges)
+	{
+		pending.clear();
+		if (stream.nbVertices)
+			pending.emplace_back(0, stream.nbVertices);
+	}
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+
+	if (stream.hasNormals)
+	{
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)stream.normalsOffset);
+		glEnableVertexAttribArray(1);
+	}
+}
+
+void Mesh::releaseFences()
+{
+	for (auto& fence : m_streaming.fences)
+	{
+		releaseGLSync(fence);
+		fence = nullptr;
+	}
+}
+
 void Mesh::mergeIndices()
 {
+	m_triangleBVH.clear(); // Rebuilt with the new triangles when next used
+
 	auto tSize = m_triangles.size(), qSize = m_quads.size();
 	auto total = tSize + qSize * 2;
 	m_mergedTriangles.reserve(total);
@@ -82,35 +408,248 @@ void Mesh::mergeIndices()
 	}
 }
 
+void Mesh::optimizeIndices()
+{
+	if (m_indicesOptimization == IndicesOptimization::None || m_mergedTriangles.empty())
+		return;
+
+	const auto nbVertices = static_cast<unsigned int>(m_vertices.size());
+	m_vertexCacheStatistics.acmrBefore = averageCacheMissRatio(m_mergedTriangles, nbVertices);
+	optimizeVertexCache(m_mergedTriangles, nbVertices);
+
+	if (m_indicesOptimization == IndicesOptimization::VertexCacheAndFetch)
+	{
+		// The vertices are moved, every list must use the new indices
+		auto remap = optimizeVertexFetch(m_mergedTriangles, nbVertices);
+		remapVertices(m_vertices, remap);
+		remapVertices(m_normals, remap);
+		remapVertices(m_texCoords, remap);
+		remapIndices(m_edges, remap);
+		remapIndices(m_triangles, remap);
+		remapIndices(m_quads, remap);
+	}
+
+	m_vertexCacheStatistics.acmrAfter = averageCacheMissRatio(m_mergedTriangles, nbVertices);
+}
+
 void Mesh::updatePositions()
 {
+	if (m_storageMode == StorageMode::Static) // Immutable buffers
+		return;
+
+	const auto ranges = dirtyRanges();
+	if (ranges.empty())
+		return;
+
+	++m_positionsRevision;
+	m_boundsValid = false;
+	if (!m_triangleBVH.empty()) // Only the meshes that were picked have one
+		triangleBVH();
+
+	if (m_storageMode == StorageMode::Streaming)
+		updateStreamingPositions(ranges);
+	else
+	{
+		const auto normSize = static_cast<unsigned int>(m_normals.size());
+		glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
+		for (const auto& range : ranges)
+			glBufferSubData(GL_ARRAY_BUFFER, 3 * sizeof(float) * range.first, 3 * sizeof(float) * (range.second - range.first), &m_vertices[range.first]);
+
+		if (m_interleaved && m_normalsVBO) // The normals are interleaved with the texture coordinates
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_normalsVBO);
+			for (const auto& range : ranges)
+			{
+				auto end = std::min(range.second, normSize);
+				if (range.first < end)
+					uploadInterleaved(range.first, end - range.first);
+			}
+		}
+		else if (normSize)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_normalsVBO);
+			std::vector<std::uint32_t> packed;
+			for (const auto& range : ranges)
+			{
+				auto end = std::min(range.second, normSize);
+				if (range.first >= end)
+					continue;
+
+				const auto count = end - range.first;
+				if (m_packedNormals)
+				{
+					packed.resize(count);
+					packNormals(&m_normals[range.first], count, packed.data());
+					glBufferSubData(GL_ARRAY_BUFFER, sizeof(std::uint32_t) * range.first, sizeof(std::uint32_t) * count, packed.data());
+				}
+				else
+					glBufferSubData(GL_ARRAY_BUFFER, 3 * sizeof(float) * range.first, 3 * sizeof(float) * count, &m_normals[range.first]);
+			}
+		}
+	}
+
+
+	// Keep a copy of what was uploaded for the next comparison
+	if (m_detectChanges)
+	{
+		if (m_uploadedVertices.size() != m_vertices.size() || m_uploadedNormals.size() != m_normals.size())
+		{
+			m_uploadedVertices = m_vertices;
+			m_uploadedNormals = m_normals;
+		}
+		else
+		{
+			for (const auto& range : ranges)
+			{
+				std::copy(m_vertices.begin() + range.first, m_vertices.begin() + range.second, m_uploadedVertices.begin() + range.first);
+				auto end = std::min<std::size_t>(range.second, m_normals.size());
+				if (range.first < end)
+					std::copy(m_normals.begin() + range.first, m_normals.begin() + end, m_uploadedNormals.begin() + range.first);
+			}
+		}
+	}
+}
+
+void Mesh::updateStreamingPositions(const Ranges& ranges)
+{
+	auto& stream = m_streaming;
+	const auto nbVertices = std::min(stream.nbVertices, static_cast<unsigned int>(m_vertices.size()));
+	const auto nbNormals = stream.hasNormals ? std::min(nbVertices, static_cast<unsigned int>(m_normals.size())) : 0;
+
+	if (!stream.mapping) // Orphaning: the driver gives us a new storage, that must be completely written
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
+		glBufferData(GL_ARRAY_BUFFER, stream.regionSize, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * sizeof(float) * nbVertices, m_vertices.data());
+		if (nbNormals)
+			glBufferSubData(GL_ARRAY_BUFFER, stream.normalsOffset, 3 * sizeof(float) * nbNormals, m_normals.data());
+		return;
+	}
+
+	// The other regions will also have to be updated for these ranges
+	for (auto& pending : stream.pendingRanges)
+		pending.insert(pending.end(), ranges.begin(), ranges.end());
+
+	// Wait until the GPU has finished using the next region (it should have been some frames ago)
+	const int region = (stream.region + 1) % stream.nbRegions;
+	auto& fence = stream.fences[region];
+	if (fence)
+	{
+		auto sync = static_cast<GLsync>(fence);
+		GLenum result;
+		do
+		{
+			result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(sync);
+		fence = nullptr;
+	}
+
+	// Write the modified vertices in the region
+	auto& pending = stream.pendingRanges[region];
+	std::sort(pending.begin(), pending.end());
+	auto data = static_cast<char*>(stream.mapping) + region * stream.regionSize;
+	unsigned int written = 0; // Ranges can overlap
+	for (const auto& range : pending)
+	{
+		auto begin = std::max(range.first, written);
+		auto end = std::min(range.second, nbVertices);
+		if (begin >= end)
+			continue;
+
+		std::memcpy(data + 3 * sizeof(float) * begin, &m_vertices[begin], 3 * sizeof(float) * (end - begin));
+		auto endNormals = std::min(end, nbNormals);
+		if (begin < endNormals)
+			std::memcpy(data + stream.normalsOffset + 3 * sizeof(float) * begin, &m_normals[begin], 3 * sizeof(float) * (endNormals - begin));
+		written = end;
+	}
+	pending.clear();
+
+	// Use this region for the next draw calls
+	stream.region = region;
+	const auto offset = region * stream.regionSize;
+	glBindVertexArray(m_VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, m_verticesVBO);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * sizeof(float) * m_vertices.size(), &m_vertices[0]);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)offset);
+	if (stream.hasNormals)
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)(offset + stream.normalsOffset));
+	glBindVertexArray(0);
+}
+
+void Mesh::markDirty(unsigned int begin, unsigned int end)
+{
+	if (begin < end)
+		m_dirtyRanges.emplace_back(begin, end);
+	m_boundsValid = false;
+}
 
-	if (!m_normals.empty())
+Mesh::Ranges Mesh::dirtyRanges()
+{
+	const auto vertSize = static_cast<unsigned int>(m_vertices.size());
+	Ranges ranges;
+
+	auto addRange = [&ranges](unsigned int begin, unsigned int end) {
+		if (!ranges.empty() && begin <= ranges.back().second + rangesMergeGap)
+			ranges.back().second = std::max(ranges.back().second, end);
+		else
+			ranges.emplace_back(begin, end);
+	};
+
+	if (!m_dirtyRanges.empty()) // Ranges given by the user
 	{
-		glBindBuffer(GL_ARRAY_BUFFER, m_normalsVBO);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * sizeof(float) * m_normals.size(), &m_normals[0]);
+		std::sort(m_dirtyRanges.begin(), m_dirtyRanges.end());
+		for (const auto& range : m_dirtyRanges)
+		{
+			auto end = std::min(range.second, vertSize);
+			if (range.first < end)
+				addRange(range.first, end);
+		}
+		m_dirtyRanges.clear();
 	}
+	else if (m_detectChanges && m_uploadedVertices.size() == vertSize && m_uploadedNormals.size() == m_normals.size())
+	{
+		const bool hasNormals = (m_normals.size() == vertSize);
+		for (unsigned int i = 0; i < vertSize; ++i)
+		{
+			if (m_vertices[i] != m_uploadedVertices[i] || (hasNormals && m_normals[i] != m_uploadedNormals[i]))
+				addRange(i, i + 1);
+		}
+	}
+	else if (vertSize) // Everything
+		ranges.emplace_back(0, vertSize);
+
+	return ranges;
 }
 
 void Mesh::updateIndices()
 {
+	if (m_storageMode == StorageMode::Static) // Immutable buffers
+		return;
+
+	std::vector<GLushort> shortIndices;
+	std::pair<const void*, std::size_t> indices(nullptr, 0);
 	if (!m_mergedTriangles.empty())
-	{
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indicesEBO);
-		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m_mergedTriangles.size() * 3 * sizeof(GLuint), &m_mergedTriangles[0]);
-	}
+		indices = indicesData(m_mergedTriangles, m_shortIndices, shortIndices);
 	else if (!m_edges.empty())
+		indices = indicesData(m_edges, m_shortIndices, shortIndices);
+
+	if (indices.second)
 	{
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indicesEBO);
-		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m_edges.size() * 2 * sizeof(GLuint), &m_edges[0]);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.second, indices.first);
 	}
 
-	if (!m_texCoords.empty())
+	if (m_interleaved && m_interleavedLayout.hasTexCoords)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_normalsVBO);
+		uploadInterleaved(0, static_cast<unsigned int>(std::min(m_normals.size(), m_texCoords.size())));
+	}
+	else if (!m_texCoords.empty())
 	{
+		std::vector<std::uint16_t> packed;
+		const auto texCoords = texCoordsData(m_texCoords, m_texCoordsPacking, packed);
 		glBindBuffer(GL_ARRAY_BUFFER, m_texCoordsVBO);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, m_texCoords.size() * 2 * sizeof(float), &m_texCoords[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, texCoords.second, texCoords.first);
 	}
 }
 
@@ -121,33 +660,117 @@ void Mesh::initTexture()
 
 void Mesh::render()
 {
-	glBindVertexArray(m_VAO);
+	glBindVertexArray(vertexArray());
+	drawElements(1);
+}
 
-	if (!m_mergedTriangles.empty())
-		glDrawElements(GL_TRIANGLES, m_mergedTriangles.size() * 3, GL_UNSIGNED_INT, nullptr);
-	else if (!m_edges.empty())
-		glDrawElements(GL_LINES, m_edges.size() * 2, GL_UNSIGNED_INT, nullptr);
+void Mesh::renderInstances(unsigned int matricesBuffer, unsigned int first, unsigned int count)
+{
+	glBindVertexArray(vertexArray());
+	bindInstancesMatrices(matricesBuffer, first);
+	drawElements(count);
 }
 
-std::pair<glm::vec3, glm::vec3> boundingBox(const Mesh& mesh)
+void Mesh::drawElements(unsigned int nbInstances)
 {
-	glm::vec3 vMin, vMax;
-	for(int i = 0; i < 3; ++i)
+	GLenum mode = GL_TRIANGLES;
+	GLsizei count = 0;
+	if (!m_mergedTriangles.empty())
+		count = m_mergedTriangles.size() * 3;
+	else if (!m_edges.empty())
+	{
+		mode = GL_LINES;
+		count = m_edges.size() * 2;
+	}
+
+	if (!count)
+		return;
+
+	const GLenum type = m_shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	if (m_arenaAllocation) // The indices are relative to the first vertex of the mesh in the arena
 	{
-		vMin[i] = std::numeric_limits<float>::max();
-		vMax[i] = -std::numeric_limits<float>::max();
+		const auto offset = (GLvoid*)(m_arenaAllocation->firstIndex * m_arenaAllocation->arena().indexSize());
+		const auto baseVertex = static_cast<GLint>(m_arenaAllocation->baseVertex);
+		if (nbInstances == 1)
+			glDrawElementsBaseVertex(mode, count, type, offset, baseVertex);
+		else
+			glDrawElementsInstancedBaseVertex(mode, count, type, offset, nbInstances, baseVertex);
 	}
+	else if (nbInstances == 1)
+		glDrawElements(mode, count, type, nullptr);
+	else
+		glDrawElementsInstanced(mode, count, type, nullptr, nbInstances);
 
-	for(const auto& vertex : mesh.m_vertices)
+	// The region used by this draw must not be modified until the GPU has finished with it
+	if (m_streaming.mapping)
 	{
-		for(int i = 0; i < 3; ++i)
-		{
-			vMin[i] = std::min(vMin[i], vertex[i]);
-			vMax[i] = std::max(vMax[i], vertex[i]);
-		}
+		auto& fence = m_streaming.fences[m_streaming.region];
+		if (fence)
+			glDeleteSync(static_cast<GLsync>(fence));
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void Mesh::swapFrame(MeshFrame& frame)
+{
+	m_vertices.swap(frame.vertices);
+	m_normals.swap(frame.normals);
+	m_boundsValid = false;
+}
+
+void Mesh::setLODs(const LODs& lods)
+{
+	std::shared_ptr<const LODs> ptr;
+	if (!lods.empty())
+		ptr = std::make_shared<const LODs>(lods);
+	std::atomic_store(&m_lods, ptr);
+}
+
+std::shared_ptr<const Mesh::LODs> Mesh::lods() const
+{
+	return std::atomic_load(&m_lods);
+}
+
+const TriangleBVH& Mesh::triangleBVH()
+{
+	if (m_triangleBVH.empty() || m_triangleBVHRevision != m_revision)
+		m_triangleBVH.build(m_vertices, m_mergedTriangles);
+	else if (m_triangleBVHPositionsRevision != m_positionsRevision)
+		m_triangleBVH.refit(m_vertices);
+
+	m_triangleBVHRevision = m_revision;
+	m_triangleBVHPositionsRevision = m_positionsRevision;
+	return m_triangleBVH;
+}
+
+const Mesh::BoundingBox& Mesh::bounds() const
+{
+	if (m_boundsValid && m_boundsNbVertices == m_vertices.size())
+		return m_bounds;
+
+	m_bounds = computeBounds(m_vertices.data(), m_vertices.size());
+	m_boundsValid = true;
+	m_boundsNbVertices = m_vertices.size();
+	++m_boundsRevision;
+	return m_bounds;
+}
+
+void bindInstancesMatrices(unsigned int matricesBuffer, unsigned int first)
+{
+	// A mat4 attribute uses 4 locations, one for each column
+	glBindBuffer(GL_ARRAY_BUFFER, matricesBuffer);
+	for (GLuint i = 0; i < 4; ++i)
+	{
+		const GLuint location = instanceMatrixLocation + i;
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(first * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
 	}
+}
 
-	return std::make_pair(vMin, vMax);
+std::pair<glm::vec3, glm::vec3> boundingBox(const Mesh& mesh)
+{
+	return mesh.bounds();
 }
 
 bool operator==(const Mesh& lhs, const Mesh& rhs)
@@ -162,24 +785,24 @@ bool operator==(const Mesh& lhs, const Mesh& rhs)
 
 std::pair<glm::vec3, glm::vec3> boundingBox(const Mesh& mesh, const glm::mat4& transformation)
 {
-	glm::vec3 vMin, vMax;
-	for(int i = 0; i < 3; ++i)
-	{
-		vMin[i] = std::numeric_limits<float>::max();
-		vMax[i] = -std::numeric_limits<float>::max();
-	}
+	const auto& bb = mesh.bounds();
+	if (bb.first.x > bb.second.x) // No vertices
+		return bb;
 
-	for(const auto& vertex : mesh.m_vertices)
+	// Transform the center of the box, and project its extents on each axis
+	// This gives the box containing the 8 transformed corners, without computing them
+	const auto center = (bb.first + bb.second) * 0.5f;
+	const auto extents = (bb.second - bb.first) * 0.5f;
+	const glm::vec3 newCenter = glm::vec3(transformation * glm::vec4(center, 1));
+	glm::vec3 newExtents;
+	for(int i = 0; i < 3; ++i)
 	{
-		auto vtransformed = transformation * glm::vec4(vertex, 1);
-		for(int i = 0; i < 3; ++i)
-		{
-			vMin[i] = std::min(vMin[i], vtransformed[i]);
-			vMax[i] = std::max(vMax[i], vtransformed[i]);
-		}
+		newExtents[i] = std::abs(transformation[0][i]) * extents[0]
+			+ std::abs(transformation[1][i]) * extents[1]
+			+ std::abs(transformation[2][i]) * extents[2];
 	}
 
-	return std::make_pair(vMin, vMax);
+	return std::make_pair(newCenter - newExtents, newCenter + newExtents);
 }
 
 } // namespace simplerender
@@ -1,9 +1,16 @@
 #pragma once
 
+#include <render/BufferArena.h>
+#include <render/GLResources.h>
+#include <render/TriangleBVH.h>
+#include <render/TripleBuffer.h>
+#include <render/VertexPacking.h>
+
 #include <glm/glm.hpp>
 
 #include <array>
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace simplerender
@@ -21,18 +28,124 @@ using TexCoords = std::vector < glm::vec2 >;
 
 using IdList = std::vector < int >;
 
+// Positions and normals of a deformable mesh at one step, exchanged between the simulation and the render threads
+struct MeshFrame
+{
+	Vertices vertices;
+	Normals normals;
+};
+
+using MeshFrameBuffer = TripleBuffer < MeshFrame >;
+
+// How the positions and normals are stored on the GPU
+enum class StorageMode
+{
+	Static,		// Immutable buffers, uploaded once in init (which must be called again after any modification)
+	Dynamic,	// Updated with glBufferSubData
+	Streaming	// Persistently mapped ring buffer (or orphaning), for meshes modified at every step
+};
+
+// Formats of the attributes and of the indices on the GPU
+enum class AttributesFormat
+{
+	Full,		// Floats and 32 bits indices
+	Compact		// Packed normals (except for streaming meshes) and texture coordinates, 16 bits indices if there are less than 65536 vertices
+};
+
+// Organization of the vertex attributes in the buffers
+enum class VertexLayout
+{
+	Separate,	// One buffer per attribute
+	Interleaved	// Attributes of a vertex next to each other (built in init). Positions of dynamic meshes stay in their own buffer, and streaming meshes are not modified
+};
+
+// Size of the buffers of the mesh, in bytes
+struct BuffersMemory
+{
+	std::size_t used = 0;
+	std::size_t full = 0; // What the buffers would use with AttributesFormat::Full
+};
+
+// Reordering of the triangles done in init, only for static meshes
+enum class IndicesOptimization
+{
+	None,
+	VertexCache,		// Reorder the triangles to reuse the transformed vertices
+	VertexCacheAndFetch	// Then renumber the vertices in the order they are used (modifies every list of the mesh)
+};
+
+// Average cache miss ratio of the triangles, before and after the optimization
+struct VertexCacheStatistics
+{
+	float acmrBefore = 0, acmrAfter = 0;
+};
+
+const unsigned int instanceMatrixLocation = 3; // Vertex attribute of the per instance transformation (uses 4 locations)
+void bindInstancesMatrices(unsigned int matricesBuffer, unsigned int first); // Points the per instance transformation of the bound VAO to the buffer, starting at the index first
+
 class Mesh
 {
 public:
 	using SPtr = std::shared_ptr<Mesh>;
 
+	Mesh() = default;
+	Mesh(const Mesh& other); // Copies the geometry and the settings only, init must be called for the copy
+	Mesh& operator=(const Mesh&) = delete;
+	~Mesh();
+
+	void setStorageMode(StorageMode mode); // Must be set before init
+	StorageMode storageMode() const;
+
+	void setAttributesFormat(AttributesFormat format); // Must be set before init
+	AttributesFormat attributesFormat() const;
+	const BuffersMemory& buffersMemory() const; // Computed in prepareBuffers
+
+	void setVertexLayout(VertexLayout layout); // Must be set before init
+	VertexLayout vertexLayout() const;
+
+	// If set before init, a static mesh with triangles is stored in these shared buffers instead of its own ones
+	void setBufferArenas(const BufferArenas::SPtr& arenas);
+	const ArenaAllocation* arenaAllocation() const; // Null if the mesh is not in an arena
+	bool shortIndices() const; // If the indices are stored as unsigned shorts
+
+	void setIndicesOptimization(IndicesOptimization optimization); // Must be set before init
+	IndicesOptimization indicesOptimization() const;
+	const VertexCacheStatistics& vertexCacheStatistics() const; // Of the last optimization
+
 	void init();
 	void prepareBuffers();
 	void updatePositions();
 	void updateIndices();
 	void mergeIndices();
+	void optimizeIndices(); // Called by init for static meshes, after mergeIndices
 	void initTexture();
 	void render();
+	void renderInstances(unsigned int matricesBuffer, unsigned int first, unsigned int count); // Per instance transformations are read from the buffer, starting at the index first
+
+	void swapFrame(MeshFrame& frame); // Take the positions and normals of the frame (giving back the previous ones), updatePositions must then be called
+
+	// Only the vertices in [begin, end[ will be uploaded by the next call to updatePositions (can be called multiple times)
+	void markDirty(unsigned int begin, unsigned int end);
+
+	// If no range was marked, updatePositions compares the vertices and normals with the last uploaded ones to find what changed
+	void setChangesDetection(bool detect);
+	bool changesDetection() const;
+
+	unsigned int revision() const; // Incremented each time the buffers are created
+	unsigned int positionsRevision() const; // Incremented each time the vertices are uploaded
+
+	// Simplified versions of the mesh, from the most detailed (see MeshDecimation.h), drawn by the scene for the small instances on screen
+	using LODs = std::vector<SPtr>;
+	void setLODs(const LODs& lods); // Can be called from any thread, the levels are initialized by the scene when first drawn
+	std::shared_ptr<const LODs> lods() const; // Null if there are none
+
+	using BoundingBox = std::pair<glm::vec3, glm::vec3>;
+	const BoundingBox& bounds() const; // Of the vertices, cached until they are modified
+	void invalidateBounds(); // Must be called if m_vertices is modified without calling markDirty, updatePositions or swapFrame
+	unsigned int boundsRevision() const; // Incremented each time the bounds are recomputed
+
+	// Hierarchy over m_mergedTriangles for the ray casts, built by the first call and then refitted by updatePositions
+	const TriangleBVH& triangleBVH();
 
 	Vertices m_vertices;
 	Normals m_normals;
@@ -44,7 +157,65 @@ public:
 	TexCoords m_texCoords;
 
 	Triangles m_mergedTriangles; // With the quads
-	unsigned int m_VAO, m_verticesVBO, m_normalsVBO, m_texCoordsVBO, m_indicesEBO;
+	VertexArrayHandle m_VAO; // Null for the meshes in an arena
+	BufferHandle m_verticesVBO, m_normalsVBO, m_texCoordsVBO, m_indicesEBO;
+
+protected:
+	using Range = std::pair<unsigned int, unsigned int>; // [begin, end[
+	using Ranges = std::vector<Range>;
+
+	Ranges dirtyRanges(); // The ranges to upload, sorted and merged
+
+	void drawElements(unsigned int nbInstances);
+	void prepareInterleavedBuffers();
+	void prepareArenaBuffers();
+	unsigned int vertexArray() const; // Of the mesh or of its arena
+	void setNormalsPointer(std::size_t stride, std::size_t offset);
+	void setTexCoordsPointer(std::size_t stride, std::size_t offset);
+	void uploadInterleaved(unsigned int first, unsigned int count); // In the attributes buffer of a dynamic mesh
+	void prepareStreamingBuffer();
+	void updateStreamingPositions(const Ranges& ranges);
+	void releaseFences();
+
+	StorageMode m_storageMode = StorageMode::Dynamic;
+	AttributesFormat m_attributesFormat = AttributesFormat::Full;
+	bool m_shortIndices = false, m_packedNormals = false; // Formats chosen in prepareBuffers
+	TexCoordsPacking m_texCoordsPacking = TexCoordsPacking::Float;
+	BuffersMemory m_buffersMemory;
+	VertexLayout m_vertexLayout = VertexLayout::Separate;
+	bool m_interleaved = false; // If the layout is used (not for streaming meshes)
+	BufferArenas::SPtr m_bufferArenas;
+	std::shared_ptr<ArenaAllocation> m_arenaAllocation;
+	InterleavedLayout m_interleavedLayout; // Of the buffer containing all the attributes (static meshes), or the ones other than the positions (dynamic meshes)
+	IndicesOptimization m_indicesOptimization = IndicesOptimization::VertexCache;
+	VertexCacheStatistics m_vertexCacheStatistics;
+	unsigned int m_revision = 0, m_positionsRevision = 0;
+	Ranges m_dirtyRanges;
+	bool m_detectChanges = false;
+	Vertices m_uploadedVertices; // Copies of what is in the buffers, only used for the detection of changes
+	Normals m_uploadedNormals;
+	std::shared_ptr<const LODs> m_lods; // Only accessed with the atomic functions
+	TriangleBVH m_triangleBVH;
+	unsigned int m_triangleBVHRevision = 0, m_triangleBVHPositionsRevision = 0; // Of the mesh when the hierarchy was last updated
+
+	mutable BoundingBox m_bounds;
+	mutable bool m_boundsValid = false;
+	mutable std::size_t m_boundsNbVertices = 0;
+	mutable unsigned int m_boundsRevision = 0;
+
+	static const int streamingRegions = 3; // The CPU writes in one region while the GPU draws using another
+
+	struct StreamingBuffer
+	{
+		void* mapping = nullptr; // Null if the persistent mapping is not supported (we then use orphaning)
+		std::array<void*, streamingRegions> fences = {}; // Inserted after the draw calls using the region
+		std::array<Ranges, streamingRegions> pendingRanges; // What was modified since the region was last written
+		std::size_t regionSize = 0, normalsOffset = 0;
+		unsigned int nbVertices = 0;
+		int nbRegions = 1, region = 0;
+		bool hasNormals = false;
+	};
+	StreamingBuffer m_streaming;
 };
 
 bool operator==(const Mesh& lhs, const Mesh& rhs);
@@ -52,4 +223,63 @@ bool operator==(const Mesh& lhs, const Mesh& rhs);
 std::pair<glm::vec3, glm::vec3> boundingBox(const Mesh& mesh);
 std::pair<glm::vec3, glm::vec3> boundingBox(const Mesh& mesh, const glm::mat4& transformation);
 
+//****************************************************************************//
+
+inline void Mesh::setStorageMode(StorageMode mode)
+{ m_storageMode = mode; }
+
+inline StorageMode Mesh::storageMode() const
+{ return m_storageMode; }
+
+inline void Mesh::setAttributesFormat(AttributesFormat format)
+{ m_attributesFormat = format; }
+
+inline AttributesFormat Mesh::attributesFormat() const
+{ return m_attributesFormat; }
+
+inline const BuffersMemory& Mesh::buffersMemory() const
+{ return m_buffersMemory; }
+
+inline void Mesh::setVertexLayout(VertexLayout layout)
+{ m_vertexLayout = layout; }
+
+inline VertexLayout Mesh::vertexLayout() const
+{ return m_vertexLayout; }
+
+inline void Mesh::setBufferArenas(const BufferArenas::SPtr& arenas)
+{ m_bufferArenas = arenas; }
+
+inline const ArenaAllocation* Mesh::arenaAllocation() const
+{ return m_arenaAllocation.get(); }
+
+inline bool Mesh::shortIndices() const
+{ return m_shortIndices; }
+
+inline void Mesh::setIndicesOptimization(IndicesOptimization optimization)
+{ m_indicesOptimization = optimization; }
+
+inline IndicesOptimization Mesh::indicesOptimization() const
+{ return m_indicesOptimization; }
+
+inline const VertexCacheStatistics& Mesh::vertexCacheStatistics() const
+{ return m_vertexCacheStatistics; }
+
+inline void Mesh::setChangesDetection(bool detect)
+{ m_detectChanges = detect; }
+
+inline bool Mesh::changesDetection() const
+{ return m_detectChanges; }
+
+inline unsigned int Mesh::revision() const
+{ return m_revision; }
+
+inline unsigned int Mesh::positionsRevision() const
+{ return m_positionsRevision; }
+
+inline void Mesh::invalidateBounds()
+{ m_boundsValid = false; }
+
+inline unsigned int Mesh::boundsRevision() const
+{ return m_boundsRevision; }
+
 } // namespace simplerender
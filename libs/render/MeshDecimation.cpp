@@ -0,0 +1,620 @@
+#include <render/MeshDecimation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+
+namespace
+{
+
+using simplerender::Mesh;
+using simplerender::Triangle;
+using simplerender::Triangles;
+using simplerender::Vertices;
+
+const double boundaryWeight = 100.0; // Of the planes keeping the open borders in place
+const float minNormalsDot = 0.2f; // A collapse rotating a triangle more than that is refused (fold)
+
+// Symmetric 4x4 matrix of the squared distances to a set of planes, stored as its upper triangle
+struct Quadric
+{
+	double a[10] = {};
+
+	void addPlane(const glm::dvec3& n, double d, double weight)
+	{
+		const double p[4] = { n.x, n.y, n.z, d };
+		int k = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = i; j < 4; ++j)
+				a[k++] += weight * p[i] * p[j];
+		}
+	}
+
+	Quadric& operator+=(const Quadric& other)
+	{
+		for (int i = 0; i < 10; ++i)
+			a[i] += other.a[i];
+		return *this;
+	}
+
+	double error(const glm::vec3& pos) const
+	{
+		const double x = pos.x, y = pos.y, z = pos.z;
+		return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			+ a[7] * z * z + 2 * a[8] * z
+			+ a[9];
+	}
+};
+
+// Merging the vertex from into the vertex to. The versions invalidate the candidate when one of them is modified
+struct Collapse
+{
+	double cost = 0;
+	unsigned int from = 0, to = 0;
+	unsigned int fromVersion = 0, toVersion = 0;
+
+	bool operator<(const Collapse& other) const
+	{ return cost > other.cost; } // For a min heap
+};
+
+std::uint64_t edgeKey(unsigned int a, unsigned int b)
+{
+	if (a > b)
+		std::swap(a, b);
+	return (static_cast<std::uint64_t>(a) << 32) | b;
+}
+
+struct PositionHash
+{
+	std::size_t operator()(const glm::vec3& pos) const
+	{
+		std::uint32_t bits[3];
+		std::memcpy(bits, &pos, sizeof(bits));
+		return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+	}
+};
+
+// Index of the first vertex having the same position, normal and texture coordinates, for each vertex
+// The imported meshes can have a copy of the vertices for each triangle, which would all be seams
+std::vector<unsigned int> weldVertices(const Mesh& mesh)
+{
+	const auto& vertices = mesh.m_vertices;
+	const auto& normals = mesh.m_normals;
+	const auto& texCoords = mesh.m_texCoords;
+	const auto nb = vertices.size();
+	const bool hasNormals = (normals.size() == nb), hasTexCoords = (texCoords.size() == nb);
+
+	auto hash = [&](unsigned int index) {
+		std::size_t value = PositionHash()(vertices[index]);
+		if (hasNormals)
+			value ^= PositionHash()(normals[index]) * 31;
+		if (hasTexCoords)
+			value ^= PositionHash()(glm::vec3(texCoords[index], 0.f)) * 17;
+		return value;
+	};
+
+	auto equal = [&](unsigned int lhs, unsigned int rhs) {
+		return vertices[lhs] == vertices[rhs]
+			&& (!hasNormals || normals[lhs] == normals[rhs])
+			&& (!hasTexCoords || texCoords[lhs] == texCoords[rhs]);
+	};
+
+	std::unordered_map<unsigned int, unsigned int, decltype(hash), decltype(equal)> firstVertices(nb, hash, equal);
+	std::vector<unsigned int> welded(nb);
+	for (std::size_t i = 0; i < nb; ++i)
+	{
+		const auto index = static_cast<unsigned int>(i);
+		welded[i] = firstVertices.emplace(index, index).first->second;
+	}
+
+	return welded;
+}
+
+Triangles meshTriangles(const Mesh& mesh)
+{
+	if (!mesh.m_mergedTriangles.empty())
+		return mesh.m_mergedTriangles;
+
+	// Not initialized, same as Mesh::mergeIndices
+	Triangles triangles = mesh.m_triangles;
+	for (const auto& quad : mesh.m_quads)
+	{
+		triangles.push_back({ quad[0], quad[1], quad[3] });
+		triangles.push_back({ quad[1], quad[2], quad[3] });
+	}
+	return triangles;
+}
+
+class Decimation
+{
+public:
+	Decimation(const Vertices& vertices, Triangles triangles)
+		: m_vertices(vertices)
+		, m_triangles(std::move(triangles))
+		, m_nbTriangles(m_triangles.size())
+	{
+		const auto nbVertices = m_vertices.size();
+		m_quadrics.resize(nbVertices);
+		m_vertexTriangles.resize(nbVertices);
+		m_versions.assign(nbVertices, 0);
+		m_removedVertices.assign(nbVertices, 0);
+		m_removedTriangles.assign(m_triangles.size(), 0);
+	}
+
+	void run(std::size_t targetTriangles)
+	{
+		computeQuadrics();
+		lockSeams();
+
+		std::vector<std::uint64_t> edges;
+		edges.reserve(m_triangles.size() * 3);
+		for (const auto& triangle : m_triangles)
+		{
+			for (int i = 0; i < 3; ++i)
+				edges.push_back(edgeKey(triangle[i], triangle[(i + 1) % 3]));
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		for (auto edge : edges)
+			addCandidate(static_cast<unsigned int>(edge >> 32), static_cast<unsigned int>(edge & 0xFFFFFFFF));
+
+		while (m_nbTriangles > targetTriangles && !m_candidates.empty())
+		{
+			const auto collapse = m_candidates.top();
+			m_candidates.pop();
+			if (m_removedVertices[collapse.from] || m_removedVertices[collapse.to]
+				|| m_versions[collapse.from] != collapse.fromVersion || m_versions[collapse.to] != collapse.toVersion)
+				continue; // Outdated
+
+			if (!canCollapse(collapse.from, collapse.to))
+				continue;
+
+			apply(collapse.from, collapse.to);
+		}
+	}
+
+	const Triangles& triangles() const { return m_triangles; }
+	const std::vector<char>& removedTriangles() const { return m_removedTriangles; }
+
+protected:
+	void computeQuadrics()
+	{
+		// Plane of each triangle, weighted by its area
+		const auto nb = m_triangles.size();
+		for (std::size_t t = 0; t < nb; ++t)
+		{
+			const auto& triangle = m_triangles[t];
+			for (auto index : triangle)
+				m_vertexTriangles[index].push_back(static_cast<unsigned int>(t));
+
+			const glm::dvec3 p0 = m_vertices[triangle[0]], p1 = m_vertices[triangle[1]], p2 = m_vertices[triangle[2]];
+			const auto cross = glm::cross(p1 - p0, p2 - p0);
+			const auto length = glm::length(cross);
+			if (length <= 0)
+				continue;
+
+			const auto n = cross / length;
+			Quadric quadric;
+			quadric.addPlane(n, -glm::dot(n, p0), length * 0.5);
+			for (auto index : triangle)
+				m_quadrics[index] += quadric;
+		}
+
+		// The edges used by only one triangle are kept in place by a plane perpendicular to this triangle
+		std::unordered_map<std::uint64_t, int> edgesCount;
+		edgesCount.reserve(nb * 3);
+		for (const auto& triangle : m_triangles)
+		{
+			for (int i = 0; i < 3; ++i)
+				++edgesCount[edgeKey(triangle[i], triangle[(i + 1) % 3])];
+		}
+
+		for (const auto& triangle : m_triangles)
+		{
+			const glm::dvec3 p0 = m_vertices[triangle[0]], p1 = m_vertices[triangle[1]], p2 = m_vertices[triangle[2]];
+			const auto normal = glm::cross(p1 - p0, p2 - p0);
+			for (int i = 0; i < 3; ++i)
+			{
+				const auto a = triangle[i], b = triangle[(i + 1) % 3];
+				if (edgesCount[edgeKey(a, b)] != 1)
+					continue;
+
+				const glm::dvec3 pa = m_vertices[a], pb = m_vertices[b];
+				const auto edge = pb - pa;
+				const auto cross = glm::cross(edge, normal);
+				const auto length = glm::length(cross);
+				if (length <= 0)
+					continue;
+
+				const auto n = cross / length;
+				Quadric quadric;
+				quadric.addPlane(n, -glm::dot(n, pa), boundaryWeight * glm::dot(edge, edge));
+				m_quadrics[a] += quadric;
+				m_quadrics[b] += quadric;
+			}
+		}
+	}
+
+	// The vertices sharing their position with others are on a seam, moving them would open the mesh
+	void lockSeams()
+	{
+		std::unordered_map<glm::vec3, unsigned int, PositionHash> positions;
+		positions.reserve(m_vertices.size());
+		const auto nb = m_vertices.size();
+		m_locked.assign(nb, 0);
+		for (std::size_t i = 0; i < nb; ++i)
+		{
+			if (m_vertexTriangles[i].empty()) // Not used, or welded with another one
+				continue;
+
+			auto it = positions.emplace(m_vertices[i], static_cast<unsigned int>(i));
+			if (!it.second)
+			{
+				m_locked[i] = 1;
+				m_locked[it.first->second] = 1;
+			}
+		}
+	}
+
+	void addCandidate(unsigned int a, unsigned int b)
+	{
+		Quadric quadric = m_quadrics[a];
+		quadric += m_quadrics[b];
+
+		// The removed vertex takes the position (and attributes) of the other one
+		const bool canRemoveA = !m_locked[a], canRemoveB = !m_locked[b];
+		if (!canRemoveA && !canRemoveB)
+			return;
+
+		Collapse collapse;
+		const double costAB = canRemoveA ? quadric.error(m_vertices[b]) : std::numeric_limits<double>::max();
+		const double costBA = canRemoveB ? quadric.error(m_vertices[a]) : std::numeric_limits<double>::max();
+		if (costAB <= costBA)
+		{
+			collapse.from = a;
+			collapse.to = b;
+			collapse.cost = costAB;
+		}
+		else
+		{
+			collapse.from = b;
+			collapse.to = a;
+			collapse.cost = costBA;
+		}
+
+		collapse.fromVersion = m_versions[collapse.from];
+		collapse.toVersion = m_versions[collapse.to];
+		m_candidates.push(collapse);
+	}
+
+	void neighbors(unsigned int vertex, std::vector<unsigned int>& list) const
+	{
+		list.clear();
+		for (auto t : m_vertexTriangles[vertex])
+		{
+			if (m_removedTriangles[t])
+				continue;
+			for (auto index : m_triangles[t])
+			{
+				if (index != vertex)
+					list.push_back(index);
+			}
+		}
+		std::sort(list.begin(), list.end());
+		list.erase(std::unique(list.begin(), list.end()), list.end());
+	}
+
+	bool canCollapse(unsigned int from, unsigned int to)
+	{
+		// Link condition: the only common neighbors are the opposite vertices of the triangles of the edge
+		int sharedTriangles = 0;
+		for (auto t : m_vertexTriangles[from])
+		{
+			if (m_removedTriangles[t])
+				continue;
+			const auto& triangle = m_triangles[t];
+			if (std::find(triangle.begin(), triangle.end(), to) != triangle.end())
+				++sharedTriangles;
+		}
+		if (!sharedTriangles)
+			return false; // The edge does not exist anymore
+
+		neighbors(from, m_fromNeighbors);
+		neighbors(to, m_toNeighbors);
+		m_commonNeighbors.clear();
+		std::set_intersection(m_fromNeighbors.begin(), m_fromNeighbors.end(), m_toNeighbors.begin(), m_toNeighbors.end(), std::back_inserter(m_commonNeighbors));
+		if (static_cast<int>(m_commonNeighbors.size()) > sharedTriangles)
+			return false;
+
+		// The triangles that will remain must not flip
+		const auto& newPos = m_vertices[to];
+		for (auto t : m_vertexTriangles[from])
+		{
+			if (m_removedTriangles[t])
+				continue;
+			const auto& triangle = m_triangles[t];
+			if (std::find(triangle.begin(), triangle.end(), to) != triangle.end())
+				continue;
+
+			glm::vec3 p[3], q[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				p[i] = m_vertices[triangle[i]];
+				q[i] = (triangle[i] == from) ? newPos : p[i];
+			}
+
+			const auto before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			const auto after = glm::cross(q[1] - q[0], q[2] - q[0]);
+			const auto lengths = glm::length(before) * glm::length(after);
+			if (lengths <= 0 || glm::dot(before, after) < minNormalsDot * lengths)
+				return false;
+		}
+
+		return true;
+	}
+
+	void apply(unsigned int from, unsigned int to)
+	{
+		auto& toTriangles = m_vertexTriangles[to];
+		for (auto t : m_vertexTriangles[from])
+		{
+			if (m_removedTriangles[t])
+				continue;
+
+			auto& triangle = m_triangles[t];
+			if (std::find(triangle.begin(), triangle.end(), to) != triangle.end())
+			{
+				m_removedTriangles[t] = 1;
+				--m_nbTriangles;
+				continue;
+			}
+
+			for (auto& index : triangle)
+			{
+				if (index == from)
+					index = to;
+			}
+			toTriangles.push_back(t);
+		}
+
+		toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(), [this](unsigned int t) {
+			return m_removedTriangles[t] != 0;
+		}), toTriangles.end());
+		m_vertexTriangles[from].clear();
+
+		m_quadrics[to] += m_quadrics[from];
+		m_removedVertices[from] = 1;
+		++m_versions[to];
+
+		neighbors(to, m_toNeighbors);
+		for (auto neighbor : m_toNeighbors)
+			addCandidate(to, neighbor);
+	}
+
+	const Vertices& m_vertices;
+	Triangles m_triangles;
+	std::size_t m_nbTriangles;
+	std::vector<Quadric> m_quadrics;
+	std::vector<std::vector<unsigned int>> m_vertexTriangles;
+	std::vector<unsigned int> m_versions;
+	std::vector<char> m_locked, m_removedVertices, m_removedTriangles;
+	std::priority_queue<Collapse> m_candidates;
+	std::vector<unsigned int> m_fromNeighbors, m_toNeighbors, m_commonNeighbors; // Reused by canCollapse and apply
+};
+
+// Copy of the values of the kept vertices, if there is one value per vertex
+template <class T>
+std::vector<T> keepValues(const std::vector<T>& values, const std::vector<unsigned int>& remap, std::size_t nbKept)
+{
+	const auto nb = remap.size();
+	if (values.size() != nb)
+		return std::vector<T>();
+
+	std::vector<T> kept(nbKept);
+	for (std::size_t i = 0; i < nb; ++i)
+	{
+		if (remap[i] < nbKept)
+			kept[remap[i]] = values[i];
+	}
+	return kept;
+}
+
+// Copy of the geometry and of the formats of the mesh, that can be used by another thread
+Mesh::SPtr geometryCopy(const Mesh& mesh)
+{
+	auto copy = std::make_shared<Mesh>();
+	copy->m_vertices = mesh.m_vertices;
+	copy->m_normals = mesh.m_normals;
+	copy->m_texCoords = mesh.m_texCoords;
+	copy->m_mergedTriangles = meshTriangles(mesh);
+	copy->setStorageMode(simplerender::StorageMode::Static);
+	copy->setAttributesFormat(mesh.attributesFormat());
+	copy->setVertexLayout(mesh.vertexLayout());
+	copy->setIndicesOptimization(mesh.indicesOptimization());
+	return copy;
+}
+
+}
+
+namespace simplerender
+{
+
+Mesh::SPtr decimateMesh(const Mesh& mesh, std::size_t targetTriangles)
+{
+	auto sourceTriangles = meshTriangles(mesh);
+	const auto welded = weldVertices(mesh);
+	for (auto& triangle : sourceTriangles)
+	{
+		for (auto& index : triangle)
+			index = welded[index];
+	}
+
+	Decimation decimation(mesh.m_vertices, std::move(sourceTriangles));
+	decimation.run(targetTriangles);
+
+	// Only keep the vertices still used, in their original order
+	const auto& triangles = decimation.triangles();
+	const auto& removed = decimation.removedTriangles();
+	const auto nbVertices = mesh.m_vertices.size();
+	const auto nbTriangles = triangles.size();
+	const unsigned int unused = static_cast<unsigned int>(-1);
+	std::vector<unsigned int> remap(nbVertices, unused);
+	for (std::size_t t = 0; t < nbTriangles; ++t)
+	{
+		if (!removed[t])
+		{
+			for (auto index : triangles[t])
+				remap[index] = 0;
+		}
+	}
+
+	unsigned int nbKept = 0;
+	for (auto& index : remap)
+	{
+		if (index != unused)
+			index = nbKept++;
+	}
+
+	auto result = std::make_shared<Mesh>();
+	result->m_vertices = keepValues(mesh.m_vertices, remap, nbKept);
+	result->m_normals = keepValues(mesh.m_normals, remap, nbKept);
+	result->m_texCoords = keepValues(mesh.m_texCoords, remap, nbKept);
+	result->m_triangles.reserve(nbTriangles);
+	for (std::size_t t = 0; t < nbTriangles; ++t)
+	{
+		if (removed[t])
+			continue;
+		const auto& triangle = triangles[t];
+		result->m_triangles.push_back({ remap[triangle[0]], remap[triangle[1]], remap[triangle[2]] });
+	}
+
+	result->setStorageMode(StorageMode::Static);
+	result->setAttributesFormat(mesh.attributesFormat());
+	result->setVertexLayout(mesh.vertexLayout());
+	result->setIndicesOptimization(mesh.indicesOptimization());
+	return result;
+}
+
+Mesh::LODs createLODs(const Mesh& mesh, unsigned int nbLevels, float ratio)
+{
+	Mesh::LODs lods;
+	const Mesh* previous = &mesh;
+	auto nbTriangles = meshTriangles(mesh).size();
+	for (unsigned int i = 0; i < nbLevels; ++i)
+	{
+		const auto target = static_cast<std::size_t>(nbTriangles * ratio);
+		if (target < minLODTriangles)
+			break;
+
+		auto lod = decimateMesh(*previous, target);
+		const auto nbLodTriangles = lod->m_triangles.size();
+		if (nbLodTriangles > (nbTriangles + target) / 2) // Too many locked vertices, not worth another draw
+			break;
+
+		lods.push_back(lod);
+		previous = lod.get();
+		nbTriangles = nbLodTriangles;
+	}
+
+	return lods;
+}
+
+LODGenerator::~LODGenerator()
+{
+	wait();
+}
+
+void LODGenerator::generate(const std::vector<Mesh::SPtr>& meshes)
+{
+	removeFinished();
+
+	struct Source
+	{
+		std::weak_ptr<Mesh> mesh; // To modify
+		const Mesh* key;
+		Mesh::SPtr copy; // Of its geometry
+		unsigned int revision;
+	};
+	std::vector<Source> sources;
+	{
+		std::lock_guard<std::mutex> lock(m_queuedMutex);
+		for (const auto& mesh : meshes)
+		{
+			if (!mesh || mesh->storageMode() != StorageMode::Static || m_queued.count(mesh.get()))
+				continue;
+
+			auto copy = geometryCopy(*mesh);
+			if (copy->m_mergedTriangles.size() < minLODTriangles)
+				continue;
+
+			m_queued[mesh.get()] = ++m_revision;
+			sources.push_back({ mesh, mesh.get(), copy, m_revision });
+		}
+	}
+
+	if (sources.empty())
+		return;
+
+	m_tasks.push_back(std::async(std::launch::async, [this](const std::vector<Source>& sources) {
+		for (const auto& source : sources)
+		{
+			// Not computed if the mesh was removed or modified in the meantime
+			Mesh::LODs lods;
+			if (!source.mesh.expired() && queued(source.key, source.revision))
+				lods = createLODs(*source.copy);
+
+			std::lock_guard<std::mutex> lock(m_queuedMutex);
+			auto it = m_queued.find(source.key);
+			if (it == m_queued.end() || it->second != source.revision)
+				continue; // Discarded, and maybe queued again with its new geometry
+			m_queued.erase(it);
+			if (auto mesh = source.mesh.lock())
+				mesh->setLODs(lods);
+		}
+	}, std::move(sources)));
+}
+
+void LODGenerator::discard(const Mesh* mesh)
+{
+	std::lock_guard<std::mutex> lock(m_queuedMutex);
+	m_queued.erase(mesh);
+}
+
+bool LODGenerator::queued(const Mesh* mesh, unsigned int revision)
+{
+	std::lock_guard<std::mutex> lock(m_queuedMutex);
+	auto it = m_queued.find(mesh);
+	return it != m_queued.end() && it->second == revision;
+}
+
+void LODGenerator::wait()
+{
+	for (auto& task : m_tasks)
+		task.wait();
+	m_tasks.clear();
+}
+
+bool LODGenerator::running()
+{
+	removeFinished();
+	return !m_tasks.empty();
+}
+
+void LODGenerator::removeFinished()
+{
+	m_tasks.erase(std::remove_if(m_tasks.begin(), m_tasks.end(), [](const std::future<void>& task) {
+		return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), m_tasks.end());
+}
+
+} // namespace simplerender
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <render/Mesh.h>
+
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+namespace simplerender
+{
+
+const unsigned int defaultLODLevels = 3;
+const float defaultLODRatio = 0.25f; // Of the triangles of the previous level
+const std::size_t minLODTriangles = 64; // No level is created under this number of triangles
+
+// Returns a copy of the mesh with at most targetTriangles triangles, by quadric error edge collapses (Garland & Heckbert)
+// A vertex is merged into one of its neighbors, so the normals and texture coordinates of the remaining vertices are kept
+// Vertices sharing their position with other ones (normal or texture seams) are not moved, nor the ones making the triangles fold
+// Only the triangles and quads are used, the result is a static mesh with the formats of the source
+Mesh::SPtr decimateMesh(const Mesh& mesh, std::size_t targetTriangles);
+
+// Successive simplifications of the mesh, each one computed from the previous with ratio times its triangles
+// Stops earlier if a level cannot be simplified enough
+Mesh::LODs createLODs(const Mesh& mesh, unsigned int nbLevels = defaultLODLevels, float ratio = defaultLODRatio);
+
+// Creates the levels of detail of meshes in background threads, giving them to the meshes with Mesh::setLODs when they are ready
+class LODGenerator
+{
+public:
+	~LODGenerator(); // Waits for the running tasks
+
+	// Only the static meshes with triangles. Their geometry is copied now, so they can be initialized afterwards
+	// The meshes already queued are skipped
+	void generate(const std::vector<Mesh::SPtr>& meshes);
+	void discard(const Mesh* mesh); // The levels being computed for this mesh will not be given to it (its geometry was modified)
+	void wait();
+	bool running(); // If a task is not finished
+
+protected:
+	void removeFinished();
+	bool queued(const Mesh* mesh, unsigned int revision); // If the levels queued with this revision are still wanted
+
+	std::vector<std::future<void>> m_tasks;
+	std::mutex m_queuedMutex;
+	std::unordered_map<const Mesh*, unsigned int> m_queued; // The meshes whose levels are not computed yet, with the revision given when queued
+	unsigned int m_revision = 0;
+};
+
+} // namespace simplerender
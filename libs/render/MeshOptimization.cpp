@@ -0,0 +1,210 @@
+#include <render/MeshOptimization.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Parameters of Forsyth's algorithm
+const int scoringCacheSize = 32;
+const float cacheDecayPower = 1.5f;
+const float lastTriangleScore = 0.75f;
+const float valenceBoostScale = 2.0f;
+const float valenceBoostPower = 0.5f;
+
+// Higher for the vertices recently used and for the ones having few triangles left
+float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	if (!remainingTriangles)
+		return -1.f; // Will not be used anymore
+
+	float score = 0.f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3) // Used by the last triangle, fixed score so that the algorithm does not favor one of its edges
+			score = lastTriangleScore;
+		else
+		{
+			const float scaler = 1.f / (scoringCacheSize - 3);
+			score = std::pow(1.f - (cachePosition - 3) * scaler, cacheDecayPower);
+		}
+	}
+
+	return score + valenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -valenceBoostPower);
+}
+
+}
+
+namespace simplerender
+{
+
+float averageCacheMissRatio(const Triangles& triangles, unsigned int nbVertices, unsigned int cacheSize)
+{
+	if (triangles.empty())
+		return 0.f;
+
+	// With a FIFO, a vertex is in the cache if it was inserted less than cacheSize misses ago
+	std::vector<unsigned int> timestamps(nbVertices, 0);
+	unsigned int time = cacheSize + 1, misses = 0;
+	for (const auto& triangle : triangles)
+	{
+		for (auto index : triangle)
+		{
+			if (index < nbVertices && time - timestamps[index] > cacheSize)
+			{
+				timestamps[index] = time++;
+				++misses;
+			}
+		}
+	}
+
+	return static_cast<float>(misses) / triangles.size();
+}
+
+void optimizeVertexCache(Triangles& triangles, unsigned int nbVertices)
+{
+	const auto nbTriangles = static_cast<unsigned int>(triangles.size());
+	for (const auto& triangle : triangles)
+	{
+		if (triangle[0] >= nbVertices || triangle[1] >= nbVertices || triangle[2] >= nbVertices)
+			return; // Invalid topology, we keep it as it is
+	}
+
+	// Compressed adjacency, the triangles not yet emitted being at the beginning of the list of each vertex
+	std::vector<unsigned int> offsets(nbVertices + 1, 0);
+	for (const auto& triangle : triangles)
+	{
+		for (auto index : triangle)
+			++offsets[index + 1];
+	}
+
+	for (unsigned int i = 0; i < nbVertices; ++i)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<unsigned int> vertexTriangles(offsets.back());
+	std::vector<unsigned int> remaining(nbVertices, 0);
+	for (unsigned int i = 0; i < nbTriangles; ++i)
+	{
+		for (auto index : triangles[i])
+			vertexTriangles[offsets[index] + remaining[index]++] = i;
+	}
+
+	std::vector<int> cachePositions(nbVertices, -1);
+	std::vector<float> vertexScores(nbVertices);
+	for (unsigned int i = 0; i < nbVertices; ++i)
+		vertexScores[i] = vertexScore(-1, remaining[i]);
+
+	std::vector<char> emitted(nbTriangles, 0);
+	std::vector<unsigned int> cache, newCache;
+	cache.reserve(scoringCacheSize + 3);
+	newCache.reserve(scoringCacheSize + 3);
+
+	Triangles output;
+	output.reserve(nbTriangles);
+	unsigned int cursor = 0; // Every triangle before it has been emitted
+	int best = -1;
+	while (output.size() < nbTriangles)
+	{
+		// If no triangle uses the vertices in the cache, take the next one in the original order
+		if (best < 0)
+		{
+			while (emitted[cursor])
+				++cursor;
+			best = cursor;
+		}
+
+		const auto triangle = triangles[best];
+		emitted[best] = 1;
+		output.push_back(triangle);
+
+		// Remove the triangle from the lists of its vertices
+		for (auto index : triangle)
+		{
+			auto begin = vertexTriangles.begin() + offsets[index];
+			auto end = begin + remaining[index];
+			auto it = std::find(begin, end, static_cast<unsigned int>(best));
+			if (it != end)
+			{
+				std::iter_swap(it, end - 1);
+				--remaining[index];
+			}
+		}
+
+		// The vertices of the triangle go to the front of the cache
+		newCache.clear();
+		for (auto index : triangle)
+		{
+			if (std::find(newCache.begin(), newCache.end(), index) == newCache.end())
+				newCache.push_back(index);
+		}
+
+		for (auto index : cache)
+		{
+			if (std::find(newCache.begin(), newCache.end(), index) == newCache.end())
+				newCache.push_back(index);
+		}
+
+		// Update the scores of the vertices in the cache and the ones pushed out of it
+		const int nbCached = static_cast<int>(newCache.size());
+		for (int i = 0; i < nbCached; ++i)
+		{
+			const auto index = newCache[i];
+			cachePositions[index] = (i < scoringCacheSize) ? i : -1;
+			vertexScores[index] = vertexScore(cachePositions[index], remaining[index]);
+		}
+
+		// Then the scores of their triangles, looking for the best one
+		best = -1;
+		float bestScore = -1.f;
+		for (auto index : newCache)
+		{
+			for (unsigned int j = offsets[index], end = offsets[index] + remaining[index]; j < end; ++j)
+			{
+				const auto t = vertexTriangles[j];
+				const auto& other = triangles[t];
+				const float score = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		if (nbCached > scoringCacheSize)
+			newCache.resize(scoringCacheSize);
+		cache.swap(newCache);
+	}
+
+	triangles.swap(output);
+}
+
+std::vector<unsigned int> optimizeVertexFetch(Triangles& triangles, unsigned int nbVertices)
+{
+	const unsigned int unused = static_cast<unsigned int>(-1);
+	std::vector<unsigned int> remap(nbVertices, unused);
+	unsigned int next = 0;
+	for (auto& triangle : triangles)
+	{
+		for (auto& index : triangle)
+		{
+			if (index >= nbVertices)
+				continue;
+
+			if (remap[index] == unused)
+				remap[index] = next++;
+			index = remap[index];
+		}
+	}
+
+	for (auto& index : remap)
+	{
+		if (index == unused)
+			index = next++;
+	}
+
+	return remap;
+}
+
+} // namespace simplerender
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <render/Mesh.h>
+
+namespace simplerender
+{
+
+const unsigned int defaultCacheSize = 16; // Of the simulated post-transform cache (FIFO)
+
+// Average number of vertices transformed per triangle, between 0.5 (ideal) and 3 (no reuse)
+float averageCacheMissRatio(const Triangles& triangles, unsigned int nbVertices, unsigned int cacheSize = defaultCacheSize);
+
+// Reorders the triangles so that consecutive ones share vertices (Forsyth's algorithm, with a LRU cache)
+void optimizeVertexCache(Triangles& triangles, unsigned int nbVertices);
+
+// Renumbers the vertices in the order they are first used by the triangles, the unused ones being put at the end
+// Returns the new index of each vertex, which must be applied to the other lists with remapVertices and remapIndices
+std::vector<unsigned int> optimizeVertexFetch(Triangles& triangles, unsigned int nbVertices);
+
+template <class T>
+void remapVertices(std::vector<T>& values, const std::vector<unsigned int>& remap); // Does nothing if there is not one value per vertex
+
+template <class T>
+void remapIndices(std::vector<T>& primitives, const std::vector<unsigned int>& remap); // Invalid indices are not modified
+
+//****************************************************************************//
+
+template <class T>
+void remapVertices(std::vector<T>& values, const std::vector<unsigned int>& remap)
+{
+	const auto nb = values.size();
+	if (nb != remap.size())
+		return;
+
+	std::vector<T> tmp(nb);
+	for (std::size_t i = 0; i < nb; ++i)
+		tmp[remap[i]] = values[i];
+	values.swap(tmp);
+}
+
+template <class T>
+void remapIndices(std::vector<T>& primitives, const std::vector<unsigned int>& remap)
+{
+	const auto nb = remap.size();
+	for (auto& primitive : primitives)
+	{
+		for (auto& index : primitive)
+		{
+			if (index < nb)
+				index = remap[index];
+		}
+	}
+}
+
+} // namespace simplerender
@@ -0,0 +1,115 @@
+#include <render/NormalsComputation.h>
+#include <render/VertexKernels.h>
+
+#include <algorithm>
+#include <future>
+#include <thread>
+
+namespace
+{
+
+const unsigned int minChunkSize = 16384; // Smaller meshes are processed by the calling thread only
+
+// Calls func(first, last) on chunks of [0, count[, the first one in the calling thread and the others asynchronously
+template <class Func>
+void parallelFor(unsigned int count, Func func)
+{
+	const unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned int nbChunks = std::min(nbThreads, (count + minChunkSize - 1) / minChunkSize);
+	if (nbChunks <= 1)
+	{
+		func(0u, count);
+		return;
+	}
+
+	const unsigned int chunkSize = (count + nbChunks - 1) / nbChunks;
+	std::vector<std::future<void>> futures;
+	for (unsigned int first = chunkSize; first < count; first += chunkSize)
+		futures.push_back(std::async(std::launch::async, func, first, std::min(count, first + chunkSize)));
+
+	func(0u, chunkSize);
+	for (auto& future : futures)
+		future.get();
+}
+
+}
+
+namespace simplerender
+{
+
+void NormalsComputation::setTopology(const Triangles& triangles, unsigned int nbVertices)
+{
+	m_triangles.clear();
+	m_triangles.reserve(triangles.size());
+	for (const auto& triangle : triangles)
+	{
+		if (triangle[0] < nbVertices && triangle[1] < nbVertices && triangle[2] < nbVertices)
+			m_triangles.push_back(triangle);
+	}
+
+	// Compressed adjacency: count the triangles around each vertex, then fill the lists
+	m_offsets.assign(nbVertices + 1, 0);
+	for (const auto& triangle : m_triangles)
+	{
+		for (auto index : triangle)
+			++m_offsets[index + 1];
+	}
+
+	for (unsigned int i = 0; i < nbVertices; ++i)
+		m_offsets[i + 1] += m_offsets[i];
+
+	m_vertexTriangles.resize(m_offsets.back());
+	auto positions = m_offsets;
+	const auto nbTriangles = static_cast<unsigned int>(m_triangles.size());
+	for (unsigned int i = 0; i < nbTriangles; ++i)
+	{
+		for (auto index : m_triangles[i])
+			m_vertexTriangles[positions[index]++] = i;
+	}
+
+	m_trianglesNormals.resize(m_triangles.size());
+}
+
+bool NormalsComputation::compute(const Vertices& vertices, Normals& normals)
+{
+	const auto nb = nbVertices();
+	if (vertices.size() != nb)
+		return false;
+
+	// Each task only writes the triangles or the vertices of its chunk
+	parallelFor(static_cast<unsigned int>(m_triangles.size()), [this, &vertices](unsigned int first, unsigned int last) {
+		computeTrianglesNormals(vertices, first, last);
+	});
+
+	normals.resize(nb);
+	parallelFor(nb, [this, &normals](unsigned int first, unsigned int last) {
+		computeVerticesNormals(normals, first, last);
+	});
+
+	return true;
+}
+
+void NormalsComputation::computeTrianglesNormals(const Vertices& vertices, unsigned int first, unsigned int last)
+{
+	for (unsigned int i = first; i < last; ++i)
+	{
+		const auto& triangle = m_triangles[i];
+		const auto& p0 = vertices[triangle[0]];
+		m_trianglesNormals[i] = glm::cross(vertices[triangle[1]] - p0, vertices[triangle[2]] - p0);
+	}
+}
+
+void NormalsComputation::computeVerticesNormals(Normals& normals, unsigned int first, unsigned int last) const
+{
+	for (unsigned int i = first; i < last; ++i)
+	{
+		glm::vec3 normal(0, 0, 0);
+		for (unsigned int j = m_offsets[i], end = m_offsets[i + 1]; j < end; ++j)
+			normal += m_trianglesNormals[m_vertexTriangles[j]];
+		normals[i] = normal;
+	}
+
+	normalizeVectors(normals.data() + first, last - first);
+}
+
+} // namespace simplerender
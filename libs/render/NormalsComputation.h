@@ -0,0 +1,33 @@
+#pragma once
+
+#include <render/Mesh.h>
+
+namespace simplerender
+{
+
+// Computes the normals of a deforming mesh, each one being the sum of the normals of the adjacent triangles weighted by their area
+// The adjacency is computed once from the topology, and big meshes are then processed by multiple threads
+class NormalsComputation
+{
+public:
+	void setTopology(const Triangles& triangles, unsigned int nbVertices); // Triangles using an invalid index are ignored
+	bool compute(const Vertices& vertices, Normals& normals); // Returns false if the number of vertices is not the one given to setTopology
+
+	unsigned int nbVertices() const;
+
+protected:
+	void computeTrianglesNormals(const Vertices& vertices, unsigned int first, unsigned int last);
+	void computeVerticesNormals(Normals& normals, unsigned int first, unsigned int last) const;
+
+	Triangles m_triangles;
+	std::vector<unsigned int> m_offsets; // The triangles around the vertex i are in m_vertexTriangles, from m_offsets[i] to m_offsets[i + 1]
+	std::vector<unsigned int> m_vertexTriangles;
+	Normals m_trianglesNormals; // Not normalized, their length is twice the area of the triangle
+};
+
+//****************************************************************************//
+
+inline unsigned int NormalsComputation::nbVertices() const
+{ return m_offsets.empty() ? 0 : static_cast<unsigned int>(m_offsets.size() - 1); }
+
+} // namespace simplerender
@@ -0,0 +1,104 @@
+#include <render/RenderQueue.h>
+
+#include <array>
+
+namespace
+{
+
+// Number of bits used for each part of the key
+const int programBits = 4;
+const int idBits = 20; // For the texture, the material and the mesh
+
+const int radixBits = 8;
+const int radixPasses = 64 / radixBits;
+const int radixBuckets = 1 << radixBits;
+
+// Stable LSD radix sort, using tmp as the second buffer
+void radixSort(simplerender::RenderQueue::Items& items, simplerender::RenderQueue::Items& tmp)
+{
+	const auto nb = items.size();
+	if (nb < 2)
+		return;
+
+	// Compute the histograms of all the passes at once
+	using Histogram = std::array<std::size_t, radixBuckets>;
+	std::array<Histogram, radixPasses> histograms = {};
+	for (const auto& item : items)
+	{
+		for (int pass = 0; pass < radixPasses; ++pass)
+			++histograms[pass][(item.key >> (pass * radixBits)) & (radixBuckets - 1)];
+	}
+
+	tmp.resize(nb);
+	auto src = &items, dst = &tmp;
+	for (int pass = 0; pass < radixPasses; ++pass)
+	{
+		const int shift = pass * radixBits;
+		auto& histogram = histograms[pass];
+		if (histogram[(src->front().key >> shift) & (radixBuckets - 1)] == nb)
+			continue; // Every key has the same digit
+
+		std::size_t offset = 0;
+		for (auto& count : histogram)
+		{
+			auto tmpCount = count;
+			count = offset;
+			offset += tmpCount;
+		}
+
+		for (const auto& item : *src)
+			(*dst)[histogram[(item.key >> shift) & (radixBuckets - 1)]++] = item;
+
+		std::swap(src, dst);
+	}
+
+	if (src != &items)
+		items.swap(tmp);
+}
+
+}
+
+namespace simplerender
+{
+
+void RenderQueue::clear()
+{
+	m_items.clear();
+	m_texturesIds.clear();
+	m_materialsIds.clear();
+	m_meshesIds.clear();
+}
+
+void RenderQueue::add(unsigned int program, unsigned int texture, const void* material, const void* mesh, unsigned int index)
+{
+	// The ids wrap around if there are too many different values, this only degrades the sorting
+	const Key idMask = (Key(1) << idBits) - 1;
+	Key key = Key(program) & ((Key(1) << programBits) - 1);
+	key = (key << idBits) | (compactId(m_texturesIds, texture) & idMask);
+	key = (key << idBits) | (compactId(m_materialsIds, material) & idMask);
+	key = (key << idBits) | (compactId(m_meshesIds, mesh) & idMask);
+
+	Item item;
+	item.key = key;
+	item.index = index;
+	m_items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+	radixSort(m_items, m_tmpItems);
+}
+
+template <class T>
+unsigned int RenderQueue::compactId(IdsMap<T>& ids, const T& value)
+{
+	auto it = ids.find(value);
+	if (it != ids.end())
+		return it->second;
+
+	unsigned int id = ids.size();
+	ids.emplace(value, id);
+	return id;
+}
+
+} // namespace simplerender
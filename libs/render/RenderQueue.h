@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace simplerender
+{
+
+// Counters for the last rendered frame
+struct RenderStats
+{
+	unsigned int draws = 0, instances = 0, programSwitches = 0, textureBinds = 0;
+	unsigned int multiDraws = 0; // Calls to glMultiDrawElementsIndirect, counted in draws too
+	unsigned int visibleInstances = 0, culledInstances = 0;
+	unsigned int simplifiedInstances = 0; // Drawn with a level of detail of their mesh
+};
+
+// Sorts draw calls so that the ones sharing the same states follow each other
+// Each item gets a compact key made of (from the most significant bits): program, texture, material, mesh
+class RenderQueue
+{
+public:
+	using Key = std::uint64_t;
+
+	struct Item
+	{
+		Key key;
+		unsigned int index; // Given by the caller
+	};
+	using Items = std::vector<Item>;
+
+	void clear();
+	void add(unsigned int program, unsigned int texture, const void* material, const void* mesh, unsigned int index);
+	void sort(); // Radix sort, stable for items having the same key
+
+	const Items& items() const;
+
+protected:
+	template <class T>
+	using IdsMap = std::unordered_map<T, unsigned int>;
+
+	template <class T>
+	static unsigned int compactId(IdsMap<T>& ids, const T& value);
+
+	Items m_items, m_tmpItems;
+	IdsMap<unsigned int> m_texturesIds;
+	IdsMap<const void*> m_materialsIds, m_meshesIds;
+};
+
+//****************************************************************************//
+
+inline const RenderQueue::Items& RenderQueue::items() const
+{ return m_items; }
+
+} // namespace simplerender
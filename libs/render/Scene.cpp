@@ -1,5 +1,9 @@
+#include <render/Frustum.h>
 #include <render/Scene.h>
 #include <render/shaders.h>
+#include <render/TextureLoader.h>
+#include <render/TextureResidency.h>
+#include <render/VertexKernels.h>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
@@ -7,9 +11,97 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace
+{
+
+const unsigned int notDrawn = static_cast<unsigned int>(-1);
+
+// Above this number of ranges of modified matrices, the whole instances buffer is uploaded in one call
+const std::size_t maxUploadedRanges = 32;
+
+// Binding points of the uniform blocks of the shaders
+const GLuint cameraBinding = 0, materialsBinding = 1;
+
+// Size of the materials array in the shaders (16kB, the minimum size of a uniform block)
+// A larger list is bound by ranges of this size, a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+const unsigned int materialsPerBlock = 256;
+
+// Bits of the keys of the variants of the mesh program, in the order given to setFeatures
+const simplerender::ShaderVariants::Key normalsFeature = 1, textureFeature = 2, instancedFeature = 4;
+
+// Indices of the cached uniform locations, in the order given to setUniforms
+enum ProgramUniform { mvUniform, mvpUniform, materialUniform, textureUniform };
+
+// The uniform blocks are shared by all the programs
+void bindUniformBlocks(const simplerender::ShaderProgram& program)
+{
+	const auto id = program.id();
+	const GLuint cameraIndex = glGetUniformBlockIndex(id, "Camera");
+	if (cameraIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(id, cameraIndex, cameraBinding);
+	const GLuint materialsIndex = glGetUniformBlockIndex(id, "Materials");
+	if (materialsIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(id, materialsIndex, materialsBinding);
+}
+
+// std140 layout of the Camera block of the shaders
+struct CameraData
+{
+	glm::mat4 view, projection, viewProjection;
+};
+
+simplerender::BVH::BoundingBox instanceBoundingBox(const simplerender::ModelInstance& instance)
+{
+	if (!instance.mesh) // Empty box, the instance is not inserted in the BVH
+		return std::make_pair(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()));
+
+	return boundingBox(*instance.mesh, instance.transformation());
+}
+
+// Layout expected by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	GLuint count, instanceCount, firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+}
+
 namespace simplerender
 {
 
+ModelInstance::~ModelInstance()
+{
+	if (m_transforms)
+		m_transforms->remove(m_transformIndex);
+}
+
+void ModelInstance::setTransformation(const glm::mat4& transformation)
+{
+	if (m_transforms)
+		m_transforms->set(m_transformIndex, transformation);
+	else
+		m_transformation = transformation;
+}
+
+void ModelInstance::setTransforms(const InstanceTransforms::SPtr& transforms)
+{
+	if (transforms == m_transforms)
+		return;
+
+	const auto transformation = this->transformation();
+	if (m_transforms)
+		m_transforms->remove(m_transformIndex);
+	m_transforms = transforms;
+	m_transformIndex = m_transforms->add(transformation);
+}
+
 void Scene::initOpenGL()
 {
 	// Get OpenGL functions
@@ -27,9 +119,26 @@ void Scene::initOpenGL()
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
-	prepareProgram(m_trianglesColorProg, trianglesColorVertexShader, trianglesColorFragmentShader);
-	prepareProgram(m_trianglesTexturedProg, trianglesTextureVertexShader, trianglesTextureFragmentShader);
-	prepareProgram(m_linesProg, linesVertexShader, linesFragmentShader);
+	// Nothing is compiled here, each variant is compiled by the first draw using it
+	m_programs.setSources("#version 330 core", meshVertexShader, meshFragmentShader);
+	m_programs.setFeatures({ "NORMALS", "TEXTURE", "INSTANCED" });
+	m_programs.setUniforms({ "MV", "MVP", "materialIndex", "tex0" });
+	m_programs.setPrepareFunction(bindUniformBlocks);
+
+	m_instancesVBO.create();
+
+	m_cameraUBO.create();
+	glBindBuffer(GL_UNIFORM_BUFFER, m_cameraUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraData), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_materialsUBO.create();
+	m_materialsData.clear(); // Force the upload of the materials with the batches
+
+	// The base instance offsets the per instance matrices of each command
+	m_multiDrawSupported = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+	if (m_multiDrawSupported)
+		m_indirectBuffer.create();
+	m_instancesStates.clear(); // Force the upload of the matrices
 }
 
 void Scene::resize(int width, int height)
@@ -39,6 +148,7 @@ void Scene::resize(int width, int height)
 
 	// Setup our viewport
 	glViewport(0, 0, width, height);
+	m_viewportHeight = height;
 
 	// Compute zFar
 	const float zFar = std::max( {m_size[0], m_size[1], m_size[2]} ) * 10.f;
@@ -61,107 +171,773 @@ void Scene::render()
 	
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	for (const auto& instance : m_instances)
+	// The meshes and textures destroyed since the last frame (maybe by another thread)
+	deleteReleasedGLResources();
+	TextureLoader::instance().processUploads();
+
+	if (m_defragmentArenas)
+	{
+		m_bufferArenas->defragment();
+		m_defragmentArenas = false;
+	}
+
+	updateInstances();
+	cullInstances();
+	updateDrawMatrices();
+	updateCameraBuffer();
+
+	// Only modify the states that are different from the previous batch
+	const Program* currentProg = nullptr;
+	unsigned int currentMaterial = 0, currentMaterialsBlock = notDrawn;
+	unsigned int currentTexture = 0;
+	glActiveTexture(GL_TEXTURE0);
+
+	const auto nbBatches = m_drawBatches.size();
+	for (std::size_t i = 0; i < nbBatches; ++i)
+	{
+		const auto& batch = m_drawBatches[i];
+		const auto mesh = batch.mesh;
+		const bool multiDraw = (batch.multiDraw > 1);
+		const bool instanced = (batch.count > 1 || multiDraw);
+		const auto prog = program(batch.programType, instanced);
+		if (!prog) // Compilation error
+		{
+			if (multiDraw)
+				i += batch.multiDraw - 1;
+			continue;
+		}
+
+		const auto& uniforms = prog->uniforms;
+		const bool programChanged = (prog != currentProg);
+		if (programChanged)
+		{
+			prog->program.use();
+			if (uniforms[textureUniform] != -1)
+				glUniform1i(uniforms[textureUniform], 0);
+			currentProg = prog;
+			++m_renderStats.programSwitches;
+		}
+
+		// The instanced shaders apply the transformation of each instance to the camera of the uniform block
+		if (!instanced)
+		{
+			if (uniforms[mvUniform] != -1)
+				glUniformMatrix4fv(uniforms[mvUniform], 1, GL_FALSE, glm::value_ptr(m_drawModelviews[batch.first]));
+			glUniformMatrix4fv(uniforms[mvpUniform], 1, GL_FALSE, glm::value_ptr(m_drawMVPs[batch.first]));
+		}
+
+		if (programChanged || batch.materialIndex != currentMaterial)
+		{
+			const auto block = batch.materialIndex / materialsPerBlock;
+			if (block != currentMaterialsBlock)
+			{
+				const auto blockSize = materialsPerBlock * sizeof(MaterialData);
+				glBindBufferRange(GL_UNIFORM_BUFFER, materialsBinding, m_materialsUBO, block * blockSize, blockSize);
+				currentMaterialsBlock = block;
+			}
+
+			glUniform1i(uniforms[materialUniform], batch.materialIndex % materialsPerBlock);
+			currentMaterial = batch.materialIndex;
+		}
+
+		if (uniforms[textureUniform] != -1 && batch.texture != currentTexture)
+		{
+			glBindTexture(GL_TEXTURE_2D, batch.texture);
+			currentTexture = batch.texture;
+			++m_renderStats.textureBinds;
+		}
+
+		if (multiDraw)
+		{
+			// Every mesh of the run is in the same arena, the base instance of each command gives its first matrix
+			const auto& arena = mesh->arenaAllocation()->arena();
+			glBindVertexArray(arena.vao());
+			bindInstancesMatrices(m_instancesVBO, 0);
+			const GLenum type = arena.format().shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, type, (GLvoid*)(batch.firstCommand * sizeof(DrawElementsIndirectCommand)), batch.multiDraw, 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+			for (unsigned int j = 0; j < batch.multiDraw; ++j)
+				m_renderStats.instances += m_drawBatches[i + j].count;
+			++m_renderStats.draws;
+			++m_renderStats.multiDraws;
+			i += batch.multiDraw - 1;
+			continue;
+		}
+
+		if (instanced)
+			mesh->renderInstances(m_instancesVBO, batch.first, batch.count);
+		else
+			mesh->render();
+
+		++m_renderStats.draws;
+		m_renderStats.instances += batch.count;
+	}
+
+	if (currentTexture)
+		glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool Scene::pick(int x, int y, int width, int height, PickResult& result)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+
+	// From the near plane to the far plane through the center of the pixel
+	const float ndcX = 2.f * (x + 0.5f) / width - 1.f, ndcY = 1.f - 2.f * (y + 0.5f) / height;
+	const auto inverse = glm::inverse(m_projection * m_modelview);
+	const auto nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.f, 1.f);
+	const auto farPoint = inverse * glm::vec4(ndcX, ndcY, 1.f, 1.f);
+	const auto origin = glm::vec3(nearPoint) / nearPoint.w;
+	return raycast(Ray(origin, glm::vec3(farPoint) / farPoint.w - origin), result);
+}
+
+bool Scene::raycast(const Ray& ray, PickResult& result)
+{
+	// The boxes are sorted by their entry distance, we stop when they are behind the closest triangle
+	m_bvh.raycast(ray, m_rayHits);
+	float closest = std::numeric_limits<float>::max();
+	bool found = false;
+	for (const auto& candidate : m_rayHits)
 	{
-		const auto& mesh = instance->mesh;
+		if (candidate.first >= closest)
+			break;
+
+		// The BVH is the one of the last render, the instances may have been modified since
+		const auto index = candidate.second;
+		if (index >= m_instances.size() || m_instancesStates[index].instance != m_instances[index].get())
+			continue;
+
+		const auto& instance = m_instances[index];
+		if (!instance->mesh)
+			continue;
+
+		// The direction is not normalized in the space of the mesh, so that the distances are the same
+		auto& mesh = *instance->mesh;
+		const auto inverse = glm::inverse(instance->transformation());
+		const Ray localRay(glm::vec3(inverse * glm::vec4(ray.origin, 1.f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.f)));
+		TriangleBVH::Hit hit;
+		if (!mesh.triangleBVH().intersect(mesh.m_vertices, localRay, closest, hit))
+			continue;
+
+		closest = hit.distance;
+		found = true;
+		result.instance = instance;
+		result.triangle = hit.triangle;
+		result.barycentric = hit.barycentric;
+		result.position = ray.origin + ray.direction * hit.distance;
+		result.distance = hit.distance;
+	}
+
+	return found;
+}
+
+void Scene::updateInstances()
+{
+	bool listModified = (m_instancesStates.size() != m_instances.size());
+	std::vector<unsigned int> movedInstances; // Transformation or positions modified
+	if (!listModified)
+	{
+		const auto nb = m_instances.size();
+		for (std::size_t i = 0; i < nb; ++i)
+		{
+			const auto& instance = *m_instances[i];
+			const auto& state = m_instancesStates[i];
+			const auto mesh = instance.mesh.get();
+			const auto material = instance.material.get();
+			if (state.instance != &instance || state.mesh != mesh || state.material != material
+				|| instance.m_transforms != m_transforms // Added to another scene
+				|| (mesh && state.meshRevision != mesh->revision())
+				|| (material && state.materialRevision != material->revision()))
+			{
+				listModified = true;
+				break;
+			}
+
+			if (mesh && state.positionsRevision != mesh->positionsRevision())
+				movedInstances.push_back(i);
+		}
+	}
+
+	// The instances mark their slot when their transformation is modified, the others are not read
+	m_transforms->takeModified(m_modifiedSlots);
+	if (!listModified)
+	{
+		for (auto slot : m_modifiedSlots)
+		{
+			const auto index = (slot < m_slotsInstances.size() ? m_slotsInstances[slot] : notDrawn);
+			if (index == notDrawn) // Not in the list anymore
+				continue;
+
+			movedInstances.push_back(index);
+			m_movedInstances.push_back(index);
+		}
+	}
+
+	if (listModified)
+	{
+		m_instancesStates.clear();
+		m_instancesStates.reserve(m_instances.size());
+		m_instancesSlots.clear();
+		m_instancesSlots.reserve(m_instances.size());
+		m_movedInstances.clear();
+		for (const auto& instance : m_instances)
+		{
+			InstanceState state;
+			state.instance = instance.get();
+			state.mesh = instance->mesh.get();
+			state.material = instance->material.get();
+			state.meshRevision = state.mesh ? state.mesh->revision() : 0;
+			state.materialRevision = state.material ? state.material->revision() : 0;
+			state.positionsRevision = state.mesh ? state.mesh->positionsRevision() : 0;
+			m_instancesStates.push_back(state);
+			instance->setTransforms(m_transforms);
+			m_instancesSlots.push_back(instance->m_transformIndex);
+		}
+
+		m_slotsInstances.assign(m_transforms->size(), notDrawn);
+		const auto nb = static_cast<unsigned int>(m_instances.size());
+		for (unsigned int i = 0; i < nb; ++i)
+			m_slotsInstances[m_instancesSlots[i]] = i;
+
+		createBatches();
+		buildBVH();
+		m_drawBatchesModified = true;
+	}
+	else if (!movedInstances.empty())
+	{
+		// Only the boxes of the moved instances and their parents are updated
+		bool rebuild = false;
+		for (auto index : movedInstances)
+		{
+			const auto& instance = *m_instances[index];
+			auto& state = m_instancesStates[index];
+			state.positionsRevision = instance.mesh ? instance.mesh->positionsRevision() : 0;
+			m_instancesBoxes[index] = instanceBoundingBox(instance);
+			if (!m_bvh.refit(index, m_instancesBoxes[index]))
+				rebuild = true; // The box was or is now empty
+		}
+
+		if (rebuild)
+			buildBVH();
+	}
+}
+
+void Scene::createBatches()
+{
+	m_batches.clear();
+	m_batchesOrder.clear();
+
+	// Sort the instances by program, texture, material, then mesh
+	m_renderQueue.clear();
+	std::unordered_map<const Material*, unsigned int> texturesIds; // Material::textureId is a linear search
+	const auto nb = static_cast<unsigned int>(m_instances.size());
+	for (unsigned int i = 0; i < nb; ++i)
+	{
+		const auto& instance = m_instances[i];
+		const auto mesh = instance->mesh.get();
 		if (!mesh)
 			continue;
 
-		const auto& transformation = instance->transformation;
 		const Material* material = instance->material.get();
 		if (!material)
 			material = &defaultMaterial;
-		const auto& prog = selectProgram(mesh, material);
-		prog.program.use();
 
-		glm::mat4 modelview = m_modelview * transformation;
-		glm::mat4 modelviewProjection = m_projection * modelview;
-		if (prog.mvLoc != -1)
-			glUniformMatrix4fv(prog.mvLoc, 1, GL_FALSE, glm::value_ptr(modelview));
-		glUniformMatrix4fv(prog.mvpLoc, 1, GL_FALSE, glm::value_ptr(modelviewProjection));
+		const auto programType = selectProgram(*mesh, *material);
+		unsigned int texture = 0;
+		if (programType == ProgramType::TrianglesTextured)
+		{
+			auto it = texturesIds.find(material);
+			if (it == texturesIds.end())
+				it = texturesIds.emplace(material, material->textureId(TextureType::Diffuse, 0)).first;
+			texture = it->second;
+		}
 
-		glUniform4fv(prog.difLoc, 1, glm::value_ptr(material->diffuse));
-		glUniform4fv(prog.ambLoc, 1, glm::value_ptr(material->ambient));
-		glUniform4fv(prog.specLoc, 1, glm::value_ptr(material->specular));
-		glUniform1f(prog.shinLoc, material->shininess);
+		m_renderQueue.add(static_cast<unsigned int>(programType), texture, material, mesh, i);
+	}
+	m_renderQueue.sort();
+
+	// Create the batches (not only testing the keys, as they can have collisions)
+	std::unordered_map<const Material*, unsigned int> materialsIndices;
+	std::vector<const Material*> materials; // Ordered as the batches, so that the bound block rarely changes
+	for (const auto& item : m_renderQueue.items())
+	{
+		const auto& instance = m_instances[item.index];
+		const auto mesh = instance->mesh.get();
+		const Material* material = instance->material.get();
+		if (!material)
+			material = &defaultMaterial;
 
-		if (prog.texLoc != -1)
+		if (m_batches.empty() || m_batches.back().mesh != mesh || m_batches.back().material != material)
 		{
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, material->textureId(TextureType::Diffuse, 0));
-			glUniform1i(prog.texLoc, 0);
+			InstancesBatch batch;
+			batch.mesh = mesh;
+			batch.material = material;
+			batch.programType = selectProgram(*mesh, *material);
+			if (batch.programType == ProgramType::TrianglesTextured)
+				batch.texture = texturesIds[material];
+
+			auto it = materialsIndices.find(material);
+			if (it == materialsIndices.end())
+			{
+				it = materialsIndices.emplace(material, static_cast<unsigned int>(materials.size())).first;
+				materials.push_back(material);
+			}
+			batch.materialIndex = it->second;
+
+			batch.first = m_batchesOrder.size();
+			m_batches.push_back(batch);
 		}
 
-		mesh->render();
+		++m_batches.back().count;
+		m_batchesOrder.push_back(item.index);
+	}
+
+	updateMaterialsBuffer(materials);
+}
 
-		glBindTexture(GL_TEXTURE_2D, 0);
+void Scene::updateMaterialsBuffer(const std::vector<const Material*>& materials)
+{
+	// Whole blocks, so that the range bound for the last materials is inside the buffer
+	const auto nbBlocks = std::max<std::size_t>(1, (materials.size() + materialsPerBlock - 1) / materialsPerBlock);
+	MaterialsData data(nbBlocks * materialsPerBlock);
+	const auto nb = materials.size();
+	for (std::size_t i = 0; i < nb; ++i)
+	{
+		const auto& material = *materials[i];
+		auto& materialData = data[i];
+		materialData.diffuse = material.diffuse;
+		materialData.ambient = material.ambient;
+		materialData.specular = material.specular;
+		materialData.shininess = material.shininess;
 	}
+
+	// The batches are also recreated when the meshes or the instances are modified, only upload edited materials
+	const bool sameSize = (data.size() == m_materialsData.size());
+	if (sameSize && !std::memcmp(data.data(), m_materialsData.data(), data.size() * sizeof(MaterialData)))
+		return;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_materialsUBO);
+	if (sameSize)
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, data.size() * sizeof(MaterialData), data.data());
+	else
+		glBufferData(GL_UNIFORM_BUFFER, data.size() * sizeof(MaterialData), data.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_materialsData.swap(data);
 }
 
-void Scene::prepareProgram(ProgramStruct& ps, const char* vertexShader, const char* fragmentShader)
+void Scene::updateCameraBuffer()
 {
-	auto& prog = ps.program;
-	prog.removeShaders();
-	prog.addShaderFromMemory(ShaderType::Vertex, vertexShader);
-	prog.addShaderFromMemory(ShaderType::Fragment, fragmentShader);
-	prog.link();
+	CameraData camera;
+	camera.view = m_modelview;
+	camera.projection = m_projection;
+	camera.viewProjection = m_projection * m_modelview;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_cameraUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraData), &camera);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, cameraBinding, m_cameraUBO);
+}
 
-	ps.mvLoc = prog.uniformLocation("MV");
-	ps.mvpLoc = prog.uniformLocation("MVP");
-	ps.difLoc = prog.uniformLocation("diffuseColor");
-	ps.ambLoc = prog.uniformLocation("ambientColor");
-	ps.specLoc = prog.uniformLocation("specularColor");
-	ps.shinLoc = prog.uniformLocation("shininess");
-	ps.texLoc = prog.uniformLocation("tex0");
+void Scene::buildBVH()
+{
+	m_instancesBoxes.clear();
+	m_instancesBoxes.reserve(m_instances.size());
+	for (const auto& instance : m_instances)
+		m_instancesBoxes.push_back(instanceBoundingBox(*instance));
+
+	m_bvh.build(m_instancesBoxes);
 }
 
-Scene::ProgramStruct& Scene::selectProgram(const Mesh::SPtr mesh, const Material* material)
+void Scene::cullInstances()
 {
-	if (mesh->m_mergedTriangles.empty())
-		return m_linesProg;
+	m_bvh.frustumCull(Frustum(m_projection * m_modelview), m_visibleItems);
 
-	if(mesh->m_texCoords.empty() || material->textures.empty())
-		return m_trianglesColorProg;
+	std::vector<char> visible(m_instances.size(), 0);
+	for (auto index : m_visibleItems)
+		visible[index] = 1;
 
-	return m_trianglesTexturedProg;
+	if (visible != m_visibleInstances)
+	{
+		m_visibleInstances.swap(visible);
+		m_drawBatchesModified = true;
+	}
+
+	selectLODs();
+	updateTexturesResidency();
+
+	if (m_bufferArenas->revision() != m_arenasRevision) // The meshes have moved inside the arenas
+	{
+		m_arenasRevision = m_bufferArenas->revision();
+		m_drawBatchesModified = true;
+	}
+
+	if (m_drawBatchesModified)
+	{
+		createDrawBatches();
+		createMultiDraws();
+		m_drawBatchesModified = false;
+	}
+	else
+		updateMovedInstances();
+
+	m_renderStats = RenderStats();
+	m_renderStats.visibleInstances = m_visibleItems.size();
+	m_renderStats.culledInstances = m_batchesOrder.size() - m_visibleItems.size();
+	m_renderStats.simplifiedInstances = m_simplifiedInstances;
 }
 
-std::pair<glm::vec3, glm::vec3> boundingBox(const Scene& scene)
+void Scene::selectLODs()
 {
-	bool hasInstances = false;
-	for (const auto& instance : scene.instances())
+	// The levels are given to the meshes by another thread, the lists used by the draw batches are kept here
+	bool listsModified = (m_batchesLODs.size() != m_batches.size());
+	m_batchesLODs.resize(m_batches.size());
+
+	std::vector<unsigned char> levels(m_instances.size(), 0);
+	const float projectionScale = m_projection[1][1] * 0.5f; // From the view space to a fraction of the viewport height
+	const auto nbBatches = m_batches.size();
+	for (std::size_t b = 0; b < nbBatches; ++b)
 	{
-		if (instance->mesh)
+		const auto& batch = m_batches[b];
+		std::shared_ptr<const Mesh::LODs> lods;
+		if (m_lodThreshold > 0 && batch.mesh->storageMode() == StorageMode::Static)
+			lods = batch.mesh->lods();
+		if (lods != m_batchesLODs[b])
 		{
-			hasInstances = true;
-			break;
+			m_batchesLODs[b] = lods;
+			listsModified = true;
 		}
+
+		if (!lods)
+			continue;
+
+		// Using the bounding sphere of the world box of each instance
+		const auto nbLevels = lods->size();
+		for (unsigned int i = batch.first; i < batch.first + batch.count; ++i)
+		{
+			const auto index = m_batchesOrder[i];
+			if (!m_visibleInstances[index])
+				continue;
+
+			const auto& box = m_instancesBoxes[index];
+			const glm::vec3 center = (box.first + box.second) * 0.5f;
+			const float radius = glm::length(box.second - box.first) * 0.5f;
+			const float distance = -(m_modelview * glm::vec4(center, 1.f)).z;
+			if (distance <= radius) // The camera is inside the sphere
+				continue;
+
+			const float size = radius * projectionScale / distance;
+			unsigned char level = 0;
+			for (float threshold = m_lodThreshold; level < nbLevels && size < threshold; threshold *= 0.5f)
+				++level;
+			levels[index] = level;
+		}
+	}
+
+	if (listsModified || levels != m_instancesLODs)
+	{
+		m_instancesLODs.swap(levels);
+		m_drawBatchesModified = true;
+	}
+}
+
+void Scene::updateTexturesResidency()
+{
+	// Only the diffuse texture is drawn, its coordinates are supposed to cover the mesh once
+	const float projectionScale = m_projection[1][1] * m_viewportHeight; // From the view space to a diameter in pixels
+	auto& residency = TextureResidency::instance();
+	for (const auto& batch : m_batches)
+	{
+		if (batch.programType != ProgramType::TrianglesTextured)
+			continue;
+
+		const auto texture = batch.material->texture(TextureType::Diffuse, 0);
+		if (!texture)
+			continue;
+
+		float screenSize = 0;
+		bool visible = false;
+		for (unsigned int i = batch.first; i < batch.first + batch.count; ++i)
+		{
+			const auto index = m_batchesOrder[i];
+			if (!m_visibleInstances[index])
+				continue;
+
+			visible = true;
+			const auto& box = m_instancesBoxes[index];
+			const glm::vec3 center = (box.first + box.second) * 0.5f;
+			const float radius = glm::length(box.second - box.first) * 0.5f;
+			const float distance = -(m_modelview * glm::vec4(center, 1.f)).z;
+			if (distance <= radius) // The camera is inside the sphere
+			{
+				screenSize = std::numeric_limits<float>::max();
+				break;
+			}
+
+			screenSize = std::max(screenSize, radius * projectionScale / distance);
+		}
+
+		if (visible)
+			residency.use(texture, screenSize);
 	}
 
-	if (!hasInstances)
-		return std::make_pair(glm::vec3(-5, -5, -5), glm::vec3(5, 5, 5));
+	residency.update();
+}
 
-	glm::vec3 vMin, vMax;
-	for (int i = 0; i < 3; ++i)
+void Scene::createDrawBatches()
+{
+	// Same order as the batches, without the culled instances
+	m_drawBatches.clear();
+	m_drawMatrices.clear();
+	m_drawMatricesIndices.assign(m_instances.size(), notDrawn);
+	m_movedInstances.clear(); // Their new transformation is used
+	m_drawMatricesModified = true;
+	m_modifiedDrawMatrices.clear();
+	m_simplifiedInstances = 0;
+	const auto nbBatches = m_batches.size();
+	for (std::size_t b = 0; b < nbBatches; ++b)
 	{
-		vMin[i] = std::numeric_limits<float>::max();
-		vMax[i] = -std::numeric_limits<float>::max();
+		// One draw batch for each level of detail used by the instances of the batch
+		const auto& batch = m_batches[b];
+		const auto& lods = m_batchesLODs[b];
+		const unsigned int nbLevels = lods ? static_cast<unsigned int>(lods->size()) + 1 : 1;
+		for (unsigned int level = 0; level < nbLevels; ++level)
+		{
+			auto drawBatch = batch;
+			drawBatch.first = m_drawMatrices.size();
+			drawBatch.count = 0;
+			for (unsigned int i = batch.first; i < batch.first + batch.count; ++i)
+			{
+				const auto index = m_batchesOrder[i];
+				if (!m_visibleInstances[index] || m_instancesLODs[index] != level)
+					continue;
+
+				m_drawMatricesIndices[index] = m_drawMatrices.size();
+				m_drawMatrices.push_back(m_transforms->get(m_instancesSlots[index]));
+				++drawBatch.count;
+			}
+
+			if (!drawBatch.count)
+				continue;
+
+			if (level)
+			{
+				// The levels are initialized when first drawn
+				const auto mesh = (*lods)[level - 1].get();
+				if (!mesh->revision())
+				{
+					mesh->setBufferArenas(m_bufferArenas);
+					mesh->init();
+				}
+
+				drawBatch.mesh = mesh;
+				m_simplifiedInstances += drawBatch.count;
+			}
+
+			m_drawBatches.push_back(drawBatch);
+		}
 	}
 
-	for (const auto& instance : scene.instances())
+	glBindBuffer(GL_ARRAY_BUFFER, m_instancesVBO);
+	glBufferData(GL_ARRAY_BUFFER, m_drawMatrices.size() * sizeof(glm::mat4), m_drawMatrices.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Scene::updateMovedInstances()
+{
+	auto& modified = m_modifiedDrawMatrices;
+	for (auto index : m_movedInstances)
 	{
-		if (!instance->mesh)
+		const auto drawIndex = m_drawMatricesIndices[index];
+		if (drawIndex == notDrawn)
+			continue;
+
+		m_drawMatrices[drawIndex] = m_transforms->get(m_instancesSlots[index]);
+		modified.push_back(drawIndex);
+	}
+	m_movedInstances.clear();
+
+	if (modified.empty())
+		return;
+
+	// Consecutive matrices are uploaded together
+	std::sort(modified.begin(), modified.end());
+	modified.erase(std::unique(modified.begin(), modified.end()), modified.end());
+	std::vector<std::pair<unsigned int, unsigned int>> ranges; // [begin, end[
+	for (auto index : modified)
+	{
+		if (!ranges.empty() && ranges.back().second == index)
+			++ranges.back().second;
+		else
+			ranges.emplace_back(index, index + 1);
+	}
+	if (ranges.size() > maxUploadedRanges)
+		ranges.assign(1, std::make_pair(0u, static_cast<unsigned int>(m_drawMatrices.size())));
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_instancesVBO);
+	for (const auto& range : ranges)
+		glBufferSubData(GL_ARRAY_BUFFER, range.first * sizeof(glm::mat4), (range.second - range.first) * sizeof(glm::mat4), &m_drawMatrices[range.first]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Scene::updateDrawMatrices()
+{
+	if (!m_drawMatricesModified && m_drawMatricesModelview == m_modelview && m_drawMatricesProjection == m_projection)
+	{
+		// Only the moved instances
+		const auto viewProjection = m_projection * m_modelview;
+		for (auto index : m_modifiedDrawMatrices)
+		{
+			m_drawModelviews[index] = m_modelview * m_drawMatrices[index];
+			m_drawMVPs[index] = viewProjection * m_drawMatrices[index];
+		}
+		m_modifiedDrawMatrices.clear();
+		return;
+	}
+
+	// One pass over all the matrices, instead of two products for each draw
+	const auto nb = m_drawMatrices.size();
+	m_drawModelviews.resize(nb);
+	m_drawMVPs.resize(nb);
+	multiplyMatrices(m_modelview, m_drawMatrices.data(), m_drawModelviews.data(), nb);
+	multiplyMatrices(m_projection * m_modelview, m_drawMatrices.data(), m_drawMVPs.data(), nb);
+
+	m_drawMatricesModelview = m_modelview;
+	m_drawMatricesProjection = m_projection;
+	m_drawMatricesModified = false;
+	m_modifiedDrawMatrices.clear();
+}
+
+void Scene::createMultiDraws()
+{
+	if (!m_multiDrawSupported)
+		return;
+
+	// Each command draws the instances of one batch, the material and the texture are the same for the whole run
+	auto canMerge = [](const InstancesBatch& first, const InstancesBatch& batch) {
+		return batch.programType == first.programType && batch.material == first.material && batch.texture == first.texture
+			&& batch.mesh->arenaAllocation() && &batch.mesh->arenaAllocation()->arena() == &first.mesh->arenaAllocation()->arena();
+	};
+
+	std::vector<DrawElementsIndirectCommand> commands;
+	const auto nbBatches = m_drawBatches.size();
+	std::size_t i = 0;
+	while (i < nbBatches)
+	{
+		auto& first = m_drawBatches[i];
+		std::size_t end = i + 1;
+		if (first.mesh->arenaAllocation())
+		{
+			while (end < nbBatches && canMerge(first, m_drawBatches[end]))
+				++end;
+		}
+
+		if (end - i < 2) // A single batch is drawn as before
+		{
+			++i;
 			continue;
+		}
 
-		auto bb = boundingBox(*instance->mesh.get(), instance->transformation);
-		for (int i = 0; i < 3; ++i)
+		first.multiDraw = static_cast<unsigned int>(end - i);
+		first.firstCommand = static_cast<unsigned int>(commands.size());
+		for (; i < end; ++i)
 		{
-			vMin[i] = std::min(vMin[i], bb.first[i]);
-			vMax[i] = std::max(vMax[i], bb.second[i]);
+			const auto& batch = m_drawBatches[i];
+			const auto allocation = batch.mesh->arenaAllocation();
+			DrawElementsIndirectCommand command;
+			command.count = static_cast<GLuint>(allocation->nbIndices);
+			command.instanceCount = batch.count;
+			command.firstIndex = static_cast<GLuint>(allocation->firstIndex);
+			command.baseVertex = static_cast<GLint>(allocation->baseVertex);
+			command.baseInstance = batch.first;
+			commands.push_back(command);
 		}
 	}
 
-	return std::make_pair(vMin, vMax);
+	if (commands.empty())
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+Scene::ProgramType Scene::selectProgram(const Mesh& mesh, const Material& material) const
+{
+	if (mesh.m_mergedTriangles.empty())
+		return ProgramType::Lines;
+
+	if(mesh.m_texCoords.empty() || material.textures.empty())
+		return ProgramType::TrianglesColor;
+
+	return ProgramType::TrianglesTextured;
+}
+
+const Scene::Program* Scene::program(ProgramType type, bool instanced)
+{
+	ShaderVariants::Key key = instanced ? instancedFeature : 0;
+	switch (type)
+	{
+	case ProgramType::Lines:												break;
+	case ProgramType::TrianglesColor:		key |= normalsFeature;					break;
+	case ProgramType::TrianglesTextured:	key |= normalsFeature | textureFeature;	break;
+	}
+
+	return m_programs.variant(key);
+}
+
+Scene::BoundingBox Scene::bounds() const
+{
+	const auto nb = m_instances.size();
+	bool modified = (m_instancesBounds.size() != nb);
+	m_instancesBounds.resize(nb);
+	for (std::size_t i = 0; i < nb; ++i)
+	{
+		const auto& instance = *m_instances[i];
+		const auto mesh = instance.mesh.get();
+		unsigned int revision = 0;
+		if (mesh)
+		{
+			mesh->bounds(); // Recomputed if the vertices were modified, which changes the revision
+			revision = mesh->boundsRevision();
+		}
+
+		auto& cached = m_instancesBounds[i];
+		if (cached.instance == &instance && cached.mesh == mesh && cached.boundsRevision == revision
+			&& cached.transformation == instance.transformation())
+			continue;
+
+		cached.instance = &instance;
+		cached.mesh = mesh;
+		cached.boundsRevision = revision;
+		cached.transformation = instance.transformation();
+		cached.box = instanceBoundingBox(instance);
+		modified = true;
+	}
+
+	if (!modified)
+		return m_bounds;
+
+	bool hasInstances = false;
+	glm::vec3 vMin(std::numeric_limits<float>::max()), vMax(-std::numeric_limits<float>::max());
+	for (const auto& cached : m_instancesBounds)
+	{
+		if (!cached.mesh)
+			continue;
+
+		hasInstances = true;
+		vMin = glm::min(vMin, cached.box.first);
+		vMax = glm::max(vMax, cached.box.second);
+	}
+
+	m_bounds = hasInstances ? std::make_pair(vMin, vMax) : std::make_pair(glm::vec3(-5, -5, -5), glm::vec3(5, 5, 5));
+	return m_bounds;
+}
+
+std::pair<glm::vec3, glm::vec3> boundingBox(const Scene& scene)
+{
+	return scene.bounds();
 }
 
 } // namespace simplerender
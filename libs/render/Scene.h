@@ -1,8 +1,12 @@
 #pragma once
 
+#include <render/BufferArena.h>
+#include <render/BVH.h>
+#include <render/InstanceTransforms.h>
 #include <render/Mesh.h>
 #include <render/Material.h>
-#include <render/Shader.h>
+#include <render/RenderQueue.h>
+#include <render/ShaderVariants.h>
 
 #include <glm/gtc/quaternion.hpp>
 #include <glm/detail/type_mat4x4.hpp>
@@ -10,12 +14,40 @@
 namespace simplerender
 {
 
-struct ModelInstance
+// The transformation is stored by the scene once the instance is drawn, so that the scene only reads the modified ones
+class ModelInstance
 {
+public:
 	using SPtr = std::shared_ptr<ModelInstance>;
-	glm::mat4 transformation;
+
+	ModelInstance() = default;
+	ModelInstance(const ModelInstance&) = delete;
+	ModelInstance& operator=(const ModelInstance&) = delete;
+	~ModelInstance();
+
+	void setTransformation(const glm::mat4& transformation);
+	const glm::mat4& transformation() const;
+
 	Mesh::SPtr mesh;
 	Material::SPtr material;
+
+protected:
+	friend class Scene;
+	void setTransforms(const InstanceTransforms::SPtr& transforms); // Moves the transformation in this storage
+
+	glm::mat4 m_transformation; // Until it is stored by a scene
+	InstanceTransforms::SPtr m_transforms;
+	InstanceTransforms::Index m_transformIndex = InstanceTransforms::invalid;
+};
+
+// Instance hit by a ray cast in the scene
+struct PickResult
+{
+	ModelInstance::SPtr instance;
+	unsigned int triangle = 0; // Index in the merged triangles of the instance mesh
+	glm::vec3 barycentric; // Weights of the 3 vertices of the triangle
+	glm::vec3 position; // In world coordinates
+	float distance = 0; // In the unit of the ray direction
 };
 
 class Scene
@@ -49,34 +81,155 @@ public:
 	glm::vec3 center() const;
 	glm::vec3 size() const;
 
+	// Of the instances, only the boxes of the instances modified since the last call are recomputed
+	// Not thread safe, like the bounds of the meshes: only called by the thread rendering the scene
+	// The box is (-5, -5, -5), (5, 5, 5) if there are no instances with a mesh
+	using BoundingBox = BVH::BoundingBox;
+	BoundingBox bounds() const;
+
+	const RenderStats& renderStats() const; // Counters of the last call to render
+
+	// Closest triangle under the cursor (in pixels from the top left corner of the viewport), with the camera of the last render
+	bool pick(int x, int y, int width, int height, PickResult& result);
+	bool raycast(const Ray& ray, PickResult& result); // With a ray in world coordinates, only the instances of the last render are tested
+
+	// Projected radius of an instance, relative to the viewport height, under which its first level of detail is drawn
+	// The threshold is halved for each next level, the levels are only used if it is positive
+	void setLODThreshold(float threshold);
+	float lodThreshold() const;
+
+	const BufferArenas::SPtr& bufferArenas() const; // To give to the static meshes before their initialization
+	void defragmentArenas(); // Done at the beginning of the next render, after meshes have been removed
+
 protected:
-	struct ProgramStruct
+	using Program = ShaderVariants::Variant;
+
+	enum class ProgramType { Lines, TrianglesColor, TrianglesTextured };
+
+	// Instances sharing the same mesh, material and program, drawn in one call
+	struct InstancesBatch
+	{
+		Mesh* mesh = nullptr;
+		const Material* material = nullptr;
+		ProgramType programType = ProgramType::Lines;
+		unsigned int texture = 0;
+		unsigned int materialIndex = 0; // In the materials uniform buffer
+		unsigned int first = 0, count = 0; // Range in m_batchesOrder, or in m_drawMatrices for the draw batches
+		unsigned int multiDraw = 0; // For the draw batches, number of batches (from this one) drawn by a single glMultiDrawElementsIndirect
+		unsigned int firstCommand = 0; // Index of the first indirect command of the multi draw
+	};
+	using InstancesBatches = std::vector<InstancesBatch>;
+
+	// Copy of the instances at the last update, to detect modifications (the transformations are stored apart)
+	struct InstanceState
 	{
-		ShaderProgram program;
-		int mvLoc = 0, mvpLoc = 0, difLoc = 0, ambLoc = 0, specLoc = 0, shinLoc = 0, texLoc = 0;
+		const ModelInstance* instance = nullptr;
+		const Mesh* mesh = nullptr;
+		const Material* material = nullptr;
+		unsigned int meshRevision = 0, materialRevision = 0, positionsRevision = 0;
 	};
+	using InstancesStates = std::vector<InstanceState>;
 
-	void prepareProgram(ProgramStruct& ps, const char* vertexShader, const char* fragmentShader);
-	ProgramStruct& selectProgram(const Mesh::SPtr mesh, const Material* material);
+	// std140 layout of the Material structure of the shaders
+	struct MaterialData
+	{
+		glm::vec4 diffuse, ambient, specular;
+		float shininess = 0.f, padding[3] = {};
+	};
+	using MaterialsData = std::vector<MaterialData>;
+
+	ProgramType selectProgram(const Mesh& mesh, const Material& material) const;
+	const Program* program(ProgramType type, bool instanced); // Compiled on first use, null if it failed
+
+	void updateInstances(); // Recreate the batches or refit the BVH if the instances were modified
+	void createBatches();
+	void updateMaterialsBuffer(const std::vector<const Material*>& materials); // Upload their parameters, if they were modified
+	void updateCameraBuffer();
+	void buildBVH();
+	void cullInstances(); // Test the BVH against the frustum, and recreate the draw batches if the visibility changed
+	void selectLODs(); // Of the visible instances, and recreate the draw batches if they changed
+	void updateTexturesResidency(); // Give the size on screen of the textures of the visible instances to the TextureResidency
+	void createDrawBatches(); // Only with the visible instances
+	void updateMovedInstances(); // Replace their matrices when the draw batches are not recreated, and upload only the modified ranges
+	void updateDrawMatrices(); // Combined matrices of the draws, if the camera or the transformations changed
+	void createMultiDraws(); // Group the consecutive draw batches that only differ by their mesh, if they are in the same arena
 
 	Meshes m_meshes;
 	Materials m_materials;
 	ModelInstances m_instances; // Only this list is used during rendering, the meshes and materials lists are here for convenience
 
 	glm::mat4 m_modelview, m_projection;
+	int m_viewportHeight = 0;
 	glm::vec3 m_min, m_max, m_center, m_size;
 
 	glm::quat m_rotation;
 	glm::vec3 m_translation = { 0.f, 0.f, 0.f };
 
-	ProgramStruct m_trianglesColorProg, m_trianglesTexturedProg, m_linesProg;
+	ShaderVariants m_programs;
 	Material defaultMaterial;
+
+	RenderQueue m_renderQueue;
+	RenderStats m_renderStats;
+
+	// World box of each instance, with what it was computed from
+	struct InstanceBounds
+	{
+		const ModelInstance* instance = nullptr;
+		const Mesh* mesh = nullptr;
+		unsigned int boundsRevision = 0;
+		glm::mat4 transformation;
+		BoundingBox box;
+	};
+	mutable std::vector<InstanceBounds> m_instancesBounds;
+	mutable BoundingBox m_bounds;
+
+	InstancesStates m_instancesStates;
+	InstanceTransforms::SPtr m_transforms = std::make_shared<InstanceTransforms>(); // Written by the instances, given to them by updateInstances
+	std::vector<InstanceTransforms::Index> m_instancesSlots; // Slot in m_transforms of each instance of m_instances
+	std::vector<unsigned int> m_slotsInstances; // Index in m_instances of the instance using each slot (or invalid)
+	InstanceTransforms::Indices m_modifiedSlots; // Taken from m_transforms by updateInstances
+	std::vector<unsigned int> m_movedInstances; // Since the last draw batches update
+	InstancesBatches m_batches; // Of all the instances
+	std::vector<unsigned int> m_batchesOrder; // Index in m_instances of the instances, sorted by batch
+
+	BVH m_bvh; // Over the world bounding boxes of the instances
+	BVH::BoundingBoxes m_instancesBoxes;
+	BVH::Items m_visibleItems;
+	BVH::RayHits m_rayHits;
+	std::vector<char> m_visibleInstances;
+
+	float m_lodThreshold = 0.1f;
+	std::vector<unsigned char> m_instancesLODs; // Level of detail of each instance, 0 being the mesh itself
+	std::vector<std::shared_ptr<const Mesh::LODs>> m_batchesLODs; // Of the mesh of each batch, kept while the draw batches use them
+	unsigned int m_simplifiedInstances = 0; // Drawn with a level of detail
+
+	InstancesBatches m_drawBatches; // Of the visible instances
+	std::vector<glm::mat4> m_drawMatrices; // Sorted by draw batch
+	std::vector<unsigned int> m_drawMatricesIndices; // For each instance, the index of its matrix in m_drawMatrices (or invalid if not drawn)
+	std::vector<glm::mat4> m_drawModelviews, m_drawMVPs; // Camera times m_drawMatrices, used by the batches with one instance
+	glm::mat4 m_drawMatricesModelview, m_drawMatricesProjection; // Camera used to compute them
+	bool m_drawMatricesModified = true; // All of them, else only the ones in m_modifiedDrawMatrices are computed again
+	std::vector<unsigned int> m_modifiedDrawMatrices; // Of the moved instances, since the last updateDrawMatrices
+	bool m_drawBatchesModified = true;
+	BufferHandle m_instancesVBO;
+
+	BufferArenas::SPtr m_bufferArenas = std::make_shared<BufferArenas>();
+	unsigned int m_arenasRevision = 0;
+	bool m_defragmentArenas = false;
+	BufferHandle m_cameraUBO, m_materialsUBO;
+	MaterialsData m_materialsData; // Content of the materials uniform buffer
+
+	bool m_multiDrawSupported = false; // GL 4.3 or the extensions for glMultiDrawElementsIndirect and the base instance
+	BufferHandle m_indirectBuffer;
 };
 
 std::pair<glm::vec3, glm::vec3> boundingBox(const Scene& scene);
 
 //****************************************************************************//
 
+inline const glm::mat4& ModelInstance::transformation() const
+{ return m_transforms ? m_transforms->get(m_transformIndex) : m_transformation; }
+
 inline void Scene::addMesh(const Mesh::SPtr& mesh)
 { m_meshes.push_back(mesh); }
 
@@ -122,4 +275,19 @@ inline glm::vec3 Scene::center() const
 inline glm::vec3 Scene::size() const
 { return m_size; }
 
+inline const RenderStats& Scene::renderStats() const
+{ return m_renderStats; }
+
+inline void Scene::setLODThreshold(float threshold)
+{ m_lodThreshold = threshold; }
+
+inline float Scene::lodThreshold() const
+{ return m_lodThreshold; }
+
+inline const BufferArenas::SPtr& Scene::bufferArenas() const
+{ return m_bufferArenas; }
+
+inline void Scene::defragmentArenas()
+{ m_defragmentArenas = true; }
+
 } // namespace simplerender
@@ -1,41 +1,54 @@
+#include <render/FileCache.h>
+#include <render/GLResources.h>
 #include <render/Shader.h>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
-namespace simplerender
+namespace
 {
 
-using namespace std;
-
-unsigned int m_program;
+const std::uint32_t binaryMagic = 0x42505653; // "SVPB"
+const std::uint32_t binaryVersion = 1;
 
-class ProgramId
+// Start of the files of the binary cache, followed by the binary of the program
+struct BinaryHeader
 {
-public:
-	ProgramId(unsigned int id = 0) : m_id(id) { }
-	~ProgramId() { glDeleteProgram(m_id); }
+	std::uint32_t magic = binaryMagic, version = binaryVersion;
+	std::uint32_t format = 0, size = 0;
+	std::uint64_t checksum = 0; // Of the binary
+};
 
-	unsigned int id() const { return m_id; }
+std::string& binaryCache()
+{
+	static std::string directory;
+	return directory;
+}
 
-protected:
-	unsigned int m_id;
-};
+bool binarySupported()
+{
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+		return false;
 
-//****************************************************************************//
+	GLint nbFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbFormats);
+	return nbFormats > 0;
+}
 
-bool ShaderProgram::addShaderFromMemory(ShaderType type, const std::string& content)
+GLuint compileShader(simplerender::ShaderType type, const std::string& content)
 {
 	GLuint glType = 0;
 	switch (type)
 	{
-	case ShaderType::Vertex:	glType = GL_VERTEX_SHADER;		break;
-	case ShaderType::Fragment:	glType = GL_FRAGMENT_SHADER;	break;
+	case simplerender::ShaderType::Vertex:		glType = GL_VERTEX_SHADER;		break;
+	case simplerender::ShaderType::Fragment:	glType = GL_FRAGMENT_SHADER;	break;
 	}
 
 	GLuint shader = glCreateShader(glType);
@@ -52,10 +65,48 @@ bool ShaderProgram::addShaderFromMemory(ShaderType type, const std::string& cont
 		glGetShaderInfoLog(shader, 512, nullptr, infoLog);
 		std::cout << "Error : Compilation of shader failed\n" << infoLog << std::endl;
 		glDeleteShader(shader);
-		return false;
+		return 0;
 	};
 
-	addShader(type, shader);
+	return shader;
+}
+
+}
+
+namespace simplerender
+{
+
+using namespace std;
+
+unsigned int m_program;
+
+class ProgramId
+{
+public:
+	ProgramId(unsigned int id = 0) : m_id(id) { }
+
+	unsigned int id() const { return m_id; }
+
+protected:
+	ProgramHandle m_id;
+};
+
+//****************************************************************************//
+
+bool ShaderProgram::addShaderFromMemory(ShaderType type, const std::string& content)
+{
+	// Compiled by link only if the program is not in the binary cache, the compilation errors are reported there
+	if (content.empty())
+		return false;
+
+	auto it = std::find_if(m_shaders.begin(), m_shaders.end(), [type](const ShaderPair& s){
+		return s.first == type;
+	});
+
+	if (it != m_shaders.end())
+		it->second = content;
+	else
+		m_shaders.emplace_back(type, content);
 
 	return true;
 }
@@ -88,10 +139,51 @@ bool ShaderProgram::link()
 {
 	m_programId.reset();
 
+	const auto path = binaryPath();
+	unsigned int program = path.empty() ? 0 : loadBinary(path);
+	if (!program)
+	{
+		program = compileAndLink(!path.empty());
+		if (!program)
+			return false;
+
+		if (!path.empty())
+			saveBinary(path, program);
+	}
+
+	m_programId = std::make_shared<ProgramId>(program);
+
+	removeShaders();
+
+	return true;
+}
+
+unsigned int ShaderProgram::compileAndLink(bool retrievable) const
+{
+	std::vector<GLuint> shaders;
+	auto deleteShaders = [&shaders]() {
+		for (auto shader : shaders)
+			glDeleteShader(shader);
+	};
+
+	for (const auto& source : m_shaders)
+	{
+		const auto shader = compileShader(source.first, source.second);
+		if (!shader)
+		{
+			deleteShaders();
+			return 0;
+		}
+		shaders.push_back(shader);
+	}
+
 	unsigned int program = glCreateProgram();
-	for (const auto& shader : m_shaders)
-		glAttachShader(program, shader.second);
+	for (auto shader : shaders)
+		glAttachShader(program, shader);
+	if (retrievable)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
+	deleteShaders(); // Only flagged for deletion while attached, destroyed with the program
 
 	// Print linking errors if any
 	GLint success = 0;
@@ -102,36 +194,108 @@ bool ShaderProgram::link()
 		glGetProgramInfoLog(program, 512, nullptr, infoLog);
 		std::cout << "Error : Shader program link failed\n" << infoLog << std::endl;
 		glDeleteProgram(program);
-		return false;
+		return 0;
 	}
 
-	m_programId = std::make_shared<ProgramId>(program);
+	return program;
+}
 
-	removeShaders();
+void ShaderProgram::removeShaders()
+{
+	m_shaders.clear();
+}
 
-	return true;
+void ShaderProgram::setBinaryCacheDirectory(const std::string& directory)
+{
+	binaryCache() = directory;
 }
 
-void ShaderProgram::addShader(ShaderType type, unsigned int id)
+const std::string& ShaderProgram::binaryCacheDirectory()
 {
-	auto it = std::find_if(m_shaders.begin(), m_shaders.end(), [type](const ShaderPair& s){
-		return s.first == type;
-	});
+	return binaryCache();
+}
 
-	if (it != m_shaders.end())
+std::string ShaderProgram::binaryPath() const
+{
+	const auto& directory = binaryCacheDirectory();
+	if (directory.empty() || m_shaders.empty() || !binarySupported())
+		return {};
+
+	// A new driver may not accept the binaries of the previous one
+	std::uint64_t key = fnvOffset;
+	for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
 	{
-		glDeleteShader(it->second);
-		it->second = id;
+		const auto str = reinterpret_cast<const char*>(glGetString(name));
+		if (str)
+			key = hashData(str, std::strlen(str), key);
 	}
-	else
-		m_shaders.emplace_back(type, id);
+
+	for (const auto& source : m_shaders)
+	{
+		const auto type = static_cast<int>(source.first);
+		key = hashData(&type, sizeof(type), key);
+		key = hashData(source.second.data(), source.second.size(), key);
+	}
+
+	return cacheFilePath(directory, "program", key);
 }
 
-void ShaderProgram::removeShaders()
+unsigned int ShaderProgram::loadBinary(const std::string& path) const
 {
-	for (const auto& shader : m_shaders)
-		glDeleteShader(shader.second);
-	m_shaders.clear();
+	ifstream file(path, ios::binary);
+	if (!file)
+		return 0;
+
+	BinaryHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != binaryMagic || header.version != binaryVersion || !header.size)
+		return 0;
+
+	std::vector<char> data(header.size);
+	if (!file.read(data.data(), data.size())
+		|| hashData(data.data(), data.size()) != header.checksum)
+		return 0;
+	file.close();
+
+	// The driver can still refuse it, then we compile the sources and replace the file
+	unsigned int program = glCreateProgram();
+	glProgramBinary(program, header.format, data.data(), static_cast<GLsizei>(data.size()));
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+void ShaderProgram::saveBinary(const std::string& path, unsigned int program) const
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> data(length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &written, &format, data.data());
+	if (written <= 0)
+		return;
+	data.resize(written);
+
+	BinaryHeader header;
+	header.format = format;
+	header.size = static_cast<std::uint32_t>(data.size());
+	header.checksum = hashData(data.data(), data.size());
+
+	writeFileAtomically(path, [&header, &data](std::ostream& out) {
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(data.data(), data.size());
+		return true;
+	});
 }
 
 unsigned int ShaderProgram::id() const
@@ -15,6 +15,7 @@ enum class ShaderType
 	Vertex, Fragment
 };
 
+// The shaders are compiled by link, unless the program is found in the binary cache
 class ShaderProgram
 {
 public:
@@ -23,15 +24,23 @@ public:
 	bool link();
 	void removeShaders();
 
+	// Where the linked programs are saved, keyed by their sources and the driver (disabled if empty)
+	// Invalid or outdated binaries are ignored and replaced, the directory must exist
+	static void setBinaryCacheDirectory(const std::string& directory);
+	static const std::string& binaryCacheDirectory();
+
 	unsigned int id() const;
 	void use() const;
 
 	int uniformLocation(const std::string& name) const;
 
 protected:
-	void addShader(ShaderType type, unsigned int id);
+	std::string binaryPath() const; // Empty if the cache is disabled or not supported
+	unsigned int loadBinary(const std::string& path) const; // Returns the linked program, or 0
+	void saveBinary(const std::string& path, unsigned int program) const;
+	unsigned int compileAndLink(bool retrievable) const; // If retrievable, the binary of the program will be read
 
-	using ShaderPair = std::pair<ShaderType, unsigned int>;
+	using ShaderPair = std::pair<ShaderType, std::string>; // With its source
 	std::vector<ShaderPair> m_shaders;
 	std::shared_ptr<ProgramId> m_programId;
 };
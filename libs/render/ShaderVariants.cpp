@@ -0,0 +1,90 @@
+#include <render/ShaderVariants.h>
+
+#include <sstream>
+
+namespace simplerender
+{
+
+void ShaderVariants::setSources(const std::string& version, const std::string& vertexShader, const std::string& fragmentShader)
+{
+	m_version = version;
+	m_vertexShader = vertexShader;
+	m_fragmentShader = fragmentShader;
+	m_variants.clear();
+}
+
+void ShaderVariants::setFeatures(const std::vector<std::string>& defines)
+{
+	m_features = defines;
+	m_variants.clear();
+}
+
+void ShaderVariants::setUniforms(const std::vector<std::string>& names)
+{
+	m_uniforms = names;
+	m_variants.clear();
+}
+
+void ShaderVariants::setPrepareFunction(PrepareFunc func)
+{
+	m_prepare = func;
+	m_variants.clear();
+}
+
+const ShaderVariants::Variant* ShaderVariants::variant(Key key)
+{
+	auto it = m_variants.find(key);
+	if (it != m_variants.end())
+		return it->second.get();
+
+	auto variant = std::make_unique<Variant>();
+	auto& prog = variant->program;
+	prog.addShaderFromMemory(ShaderType::Vertex, source(m_vertexShader, key));
+	prog.addShaderFromMemory(ShaderType::Fragment, source(m_fragmentShader, key));
+	if (!prog.link())
+	{
+		m_variants.emplace(key, nullptr);
+		return nullptr;
+	}
+
+	for (const auto& name : m_uniforms)
+		variant->uniforms.push_back(prog.uniformLocation(name));
+
+	if (m_prepare)
+		m_prepare(prog);
+
+	auto ptr = variant.get();
+	m_variants.emplace(key, std::move(variant));
+	return ptr;
+}
+
+void ShaderVariants::clear()
+{
+	m_variants.clear();
+}
+
+std::size_t ShaderVariants::nbCompiled() const
+{
+	std::size_t nb = 0;
+	for (const auto& variant : m_variants)
+	{
+		if (variant.second)
+			++nb;
+	}
+	return nb;
+}
+
+std::string ShaderVariants::source(const std::string& shader, Key key) const
+{
+	std::ostringstream out;
+	out << m_version << "\n";
+	for (std::size_t i = 0, nb = m_features.size(); i < nb; ++i)
+	{
+		if (key & (1u << i))
+			out << "#define " << m_features[i] << "\n";
+	}
+	out << shader;
+	return out.str();
+}
+
+} // namespace simplerender
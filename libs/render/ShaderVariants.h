@@ -0,0 +1,47 @@
+#pragma once
+
+#include <render/Shader.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simplerender
+{
+
+// Programs compiled from the same sources with different sets of #define, each one on its first use
+class ShaderVariants
+{
+public:
+	using Key = unsigned int; // Bit i enables the i-th feature
+
+	struct Variant
+	{
+		ShaderProgram program;
+		std::vector<int> uniforms; // Locations of the uniforms, in the order given to setUniforms (-1 if not used by this variant)
+	};
+
+	using PrepareFunc = std::function<void(const ShaderProgram&)>;
+
+	// The sources must not contain the #version directive, it is inserted before the defines
+	void setSources(const std::string& version, const std::string& vertexShader, const std::string& fragmentShader);
+	void setFeatures(const std::vector<std::string>& defines); // Name of the define of each bit of the keys
+	void setUniforms(const std::vector<std::string>& names);
+	void setPrepareFunction(PrepareFunc func); // Called after each compilation, for example to bind the uniform blocks
+
+	const Variant* variant(Key key); // Compiled by the first call with this key, null if the compilation failed
+	void clear(); // Destroy the programs, they will be compiled again
+	std::size_t nbCompiled() const;
+
+protected:
+	std::string source(const std::string& shader, Key key) const;
+
+	std::string m_version, m_vertexShader, m_fragmentShader;
+	std::vector<std::string> m_features, m_uniforms;
+	PrepareFunc m_prepare;
+	std::unordered_map<Key, std::unique_ptr<Variant>> m_variants; // Null for a failed compilation, so that it is not tried again
+};
+
+} // namespace simplerender
@@ -1,4 +1,7 @@
+#include <render/FileCache.h>
 #include <render/Texture.h>
+#include <render/TextureLoader.h>
+#include <render/TextureResidency.h>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
@@ -6,66 +9,475 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+using Image = simplerender::Texture::Image;
+using Contents = std::shared_ptr<const std::vector<unsigned char>>;
+
+const std::uint32_t cacheMagic = 0x58455453; // "STEX"
+const std::uint32_t cacheVersion = 1;
+
+// Start of the files of the texture cache, followed by the pixels of all the levels, from the source image to 1x1
+struct CacheHeader
+{
+	std::uint32_t magic = cacheMagic, version = cacheVersion;
+	std::uint64_t key = 0; // Of the source
+	std::uint32_t width = 0, height = 0, channels = 0, levels = 0;
+	std::uint64_t size = 0; // Of the pixels
+};
+
+std::string& textureCache()
+{
+	static std::string directory;
+	return directory;
+}
+
+std::size_t& textureCacheSize()
+{
+	static std::size_t size = simplerender::defaultTextureCacheSize;
+	return size;
+}
+
+// The file is identified by its path, modification time and size, the contents by themselves
+std::uint64_t sourceKey(const std::string& path, const Contents& contents)
+{
+	if (contents)
+		return simplerender::hashData(contents->data(), contents->size());
+
+	struct stat info;
+	if (stat(path.c_str(), &info))
+		return 0;
+
+	const std::int64_t modification = info.st_mtime, size = info.st_size;
+	auto key = simplerender::hashData(path.data(), path.size());
+	key = simplerender::hashData(&modification, sizeof(modification), key);
+	return simplerender::hashData(&size, sizeof(size), key);
+}
+
+std::string cachePath(std::uint64_t key)
+{
+	const auto& directory = textureCache();
+	if (directory.empty() || !key)
+		return {};
+
+	return simplerender::cacheFilePath(directory, "texture", key);
+}
+
+// Read-only mapping of a whole file, unmapped when the last image using it is destroyed
+std::shared_ptr<const unsigned char> mapFile(const std::string& path, std::size_t& size)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping)
+		return nullptr;
+
+	auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping); // Kept open by the view
+	if (!view)
+		return nullptr;
+
+	size = static_cast<std::size_t>(fileSize.QuadPart);
+	return std::shared_ptr<const unsigned char>(static_cast<const unsigned char*>(view), [](const unsigned char* data) {
+		UnmapViewOfFile(data);
+	});
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file == -1)
+		return nullptr;
+
+	struct stat info;
+	void* data = MAP_FAILED;
+	if (!fstat(file, &info) && info.st_size > 0)
+		data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file); // Kept open by the mapping
+	if (data == MAP_FAILED)
+		return nullptr;
+
+	const auto mappedSize = static_cast<std::size_t>(info.st_size);
+	size = mappedSize;
+	return std::shared_ptr<const unsigned char>(static_cast<const unsigned char*>(data), [mappedSize](const unsigned char* data) {
+		munmap(const_cast<unsigned char*>(data), mappedSize);
+	});
+#endif
+}
+
+unsigned int nbLevels(int width, int height)
+{
+	unsigned int levels = 1;
+	for (int size = std::max(width, height); size > 1; size /= 2)
+		++levels;
+	return levels;
+}
+
+// The buffer of stb_image is kept, and the channels of the file (the gray images are expanded by the sampler)
+Image makeImage(stbi_uc* pixels, int width, int height, int channels)
+{
+	Image image;
+	if (!pixels)
+		return image;
+
+	image.pixels = std::shared_ptr<const unsigned char>(pixels, stbi_image_free);
+	image.width = width;
+	image.height = height;
+	image.channels = channels;
+	return image;
+}
+
+Image decode(const std::string& path, const Contents& contents)
+{
+	int width = 0, height = 0, channels = 0;
+	stbi_uc* pixels = nullptr;
+	if (contents)
+	{
+		if (!contents->empty())
+			pixels = stbi_load_from_memory(contents->data(), static_cast<int>(contents->size()), &width, &height, &channels, 0);
+	}
+	else
+		pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+	return makeImage(pixels, width, height, channels);
+}
+
+// Next level with a box filter (the last row or column of an odd size is dropped)
+Image halve(const Image& image)
+{
+	Image half;
+	half.width = std::max(image.width / 2, 1);
+	half.height = std::max(image.height / 2, 1);
+	half.channels = image.channels;
+	half.level = image.level + 1;
+	auto buffer = static_cast<unsigned char*>(std::malloc(half.size()));
+	if (!buffer)
+		return {};
+
+	const int channels = image.channels;
+	const std::size_t rowSize = static_cast<std::size_t>(image.width) * channels;
+	auto dst = buffer;
+	for (int y = 0; y < half.height; ++y)
+	{
+		const auto row0 = image.pixels.get() + std::min(2 * y, image.height - 1) * rowSize;
+		const auto row1 = image.pixels.get() + std::min(2 * y + 1, image.height - 1) * rowSize;
+		for (int x = 0; x < half.width; ++x)
+		{
+			const int x0 = std::min(2 * x, image.width - 1) * channels, x1 = std::min(2 * x + 1, image.width - 1) * channels;
+			for (int c = 0; c < channels; ++c)
+				*dst++ = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+
+	half.pixels = std::shared_ptr<const unsigned char>(buffer, std::free);
+	return half;
+}
+
+Image reduce(Image image, unsigned int level)
+{
+	while (image.pixels && image.level < level && (image.width > 1 || image.height > 1))
+		image = halve(image);
+	return image;
+}
+
+// The levels from the requested one to the end of the chain, without copying them
+Image loadCached(const std::string& path, std::uint64_t key, unsigned int level)
+{
+	std::size_t fileSize = 0;
+	auto mapping = mapFile(path, fileSize);
+	if (!mapping || fileSize < sizeof(CacheHeader))
+		return {};
+
+	CacheHeader header;
+	std::memcpy(&header, mapping.get(), sizeof(header));
+	if (header.magic != cacheMagic || header.version != cacheVersion || header.key != key
+		|| !header.width || !header.height || header.channels < 1 || header.channels > 4
+		|| header.levels != nbLevels(header.width, header.height) || fileSize - sizeof(header) < header.size)
+		return {};
+
+	Image chain; // To compute the sizes of the levels
+	chain.width = header.width;
+	chain.height = header.height;
+	chain.channels = header.channels;
+	std::size_t offset = 0;
+	for (unsigned int i = 1; i < header.levels; ++i)
+	{
+		offset += chain.levelSize(i - 1);
+		chain.mipmaps.push_back(offset);
+	}
+	if (chain.size() != header.size)
+		return {};
+
+	level = std::min(level, header.levels - 1);
+	const auto first = level ? chain.mipmaps[level - 1] : 0;
+	Image image;
+	image.pixels = std::shared_ptr<const unsigned char>(mapping, mapping.get() + sizeof(header) + first);
+	image.width = std::max(chain.width >> level, 1);
+	image.height = std::max(chain.height >> level, 1);
+	image.channels = chain.channels;
+	image.level = level;
+	for (unsigned int i = level + 1; i < header.levels; ++i)
+		image.mipmaps.push_back(chain.mipmaps[i - 1] - first);
+	return image;
+}
+
+// The levels are computed from the source image and written one after the other
+bool saveCached(const std::string& path, std::uint64_t key, const Image& image)
+{
+	CacheHeader header;
+	header.key = key;
+	header.width = image.width;
+	header.height = image.height;
+	header.channels = image.channels;
+	header.levels = nbLevels(image.width, image.height);
+	for (unsigned int i = 0; i < header.levels; ++i)
+		header.size += image.levelSize(i);
+
+	return simplerender::writeFileAtomically(path, [&header, &image](std::ostream& out) {
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(image.pixels.get()), image.size());
+		Image level;
+		const Image* previous = &image;
+		for (unsigned int i = 1; i < header.levels && out; ++i)
+		{
+			level = halve(*previous);
+			if (!level.pixels)
+				break;
+			out.write(reinterpret_cast<const char*>(level.pixels.get()), level.size());
+			previous = &level;
+		}
+		return previous->level == header.levels - 1;
+	});
+}
+
+// From the cache if possible, else the source is decoded (and added to the cache)
+Image loadImage(const std::string& sourcePath, const Contents& contents, unsigned int level)
+{
+	const auto key = sourceKey(sourcePath, contents);
+	const auto path = cachePath(key);
+	if (!path.empty())
+	{
+		auto image = loadCached(path, key, level);
+		if (image.pixels)
+		{
+			simplerender::touchFile(path); // Used last
+			return image;
+		}
+	}
+
+	auto image = decode(sourcePath, contents);
+	if (image.pixels && !path.empty() && saveCached(path, key, image))
+	{
+		simplerender::trimCacheFiles(textureCache(), "texture", textureCacheSize()); // The new file is the most recent one
+		auto cached = loadCached(path, key, level);
+		if (cached.pixels)
+			return cached;
+	}
+
+	return reduce(std::move(image), level);
+}
+
+}
+
 namespace simplerender
 {
 
-Texture::~Texture()
+std::size_t Texture::Image::levelSize(unsigned int mipmap) const
 {
-	glDeleteTextures(1, &m_textureId);
+	return static_cast<std::size_t>(std::max(width >> mipmap, 1)) * std::max(height >> mipmap, 1) * channels;
 }
 
-bool Texture::loadFromFile(const std::string& path)
+std::size_t Texture::Image::size() const
 {
-	int width, height, comp;
-	stbi_uc* image = stbi_load(path.c_str(), &width, &height, &comp, 3);
-	if (!image)
-		return false;
+	const auto nbMipmaps = static_cast<unsigned int>(mipmaps.size());
+	return (nbMipmaps ? mipmaps.back() : 0) + levelSize(nbMipmaps);
+}
 
-	std::vector<unsigned char> contents(image, image + (width * height * 3));
-	stbi_image_free(image);
-	setContents(contents, width, height);
-	return true;
+void Texture::setCacheDirectory(const std::string& directory)
+{
+	textureCache() = directory;
+}
+
+const std::string& Texture::cacheDirectory()
+{
+	return textureCache();
+}
+
+void Texture::setCacheSize(std::size_t size)
+{
+	textureCacheSize() = size;
+}
+
+std::size_t Texture::cacheSize()
+{
+	return textureCacheSize();
+}
+
+bool Texture::loadFromFile(const std::string& path)
+{
+	setSource(path, nullptr);
+	setImage(loadImage(path, nullptr, 0));
+	return state() == State::Decoded;
 }
 
 bool Texture::loadFromMemory(const std::vector<unsigned char>& fileContents)
 {
-	int width, height, comp;
-	stbi_uc* image = stbi_load_from_memory(&fileContents[0], fileContents.size(), &width, &height, &comp, 3);
-	if (!image)
-		return false;
+	auto contents = std::make_shared<const std::vector<unsigned char>>(fileContents);
+	setSource({}, contents);
+	setImage(loadImage({}, contents, 0));
+	return state() == State::Decoded;
+}
+
+void Texture::loadFromFileAsync(const std::string& path)
+{
+	setSource(path, nullptr);
+	decodeAsync(0);
+}
 
-	std::vector<unsigned char> contents(image, image + (width * height * 3));
-	stbi_image_free(image);
-	setContents(contents, width, height);
-	return true;
+void Texture::loadFromMemoryAsync(const std::vector<unsigned char>& fileContents)
+{
+	setSource({}, std::make_shared<const std::vector<unsigned char>>(fileContents));
+	decodeAsync(0);
+}
+
+void Texture::setSource(const std::string& path, const std::shared_ptr<const std::vector<unsigned char>>& contents)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_sourcePath = path;
+	m_sourceContents = contents;
+}
+
+void Texture::decodeAsync(unsigned int level)
+{
+	std::string path;
+	Contents contents;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_state = State::Decoding;
+		path = m_sourcePath;
+		contents = m_sourceContents;
+	}
+
+	std::weak_ptr<Texture> weakTexture = shared_from_this();
+	TextureLoader::instance().decode([weakTexture, path, contents, level]() {
+		if (weakTexture.expired())
+			return;
+
+		auto image = loadImage(path, contents, level);
+		if (auto texture = weakTexture.lock())
+			texture->setImage(std::move(image));
+	});
+}
+
+void Texture::reload(unsigned int level)
+{
+	if (!m_textureId || m_uploadQueued || !reloadable())
+		return;
+
+	decodeAsync(level);
+	m_uploadQueued = true;
+	TextureLoader::instance().addUpload(shared_from_this());
 }
 
 void Texture::setContents(const std::vector<unsigned char>& contents, int width, int height, bool hasAlpha)
 {
-	m_contents = std::make_unique<TextureContents>();
-	m_contents->contents = contents;
-	m_contents->width = width;
-	m_contents->height = height;
-	m_contents->hasAlpha = hasAlpha;
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.channels = hasAlpha ? 4 : 3;
+	setSource({}, nullptr); // Cannot be reloaded
+	if (contents.size() >= image.size())
+	{
+		auto buffer = static_cast<unsigned char*>(std::malloc(image.size()));
+		if (buffer)
+		{
+			std::memcpy(buffer, contents.data(), image.size());
+			image.pixels = std::shared_ptr<const unsigned char>(buffer, std::free);
+		}
+	}
+
+	setImage(std::move(image));
+}
+
+void Texture::setImage(Image image)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_state = image.pixels ? State::Decoded : State::Failed;
+	if (image.pixels && !image.level)
+	{
+		m_sourceWidth = image.width;
+		m_sourceHeight = image.height;
+	}
+	m_image = std::move(image);
+}
+
+Texture::Image Texture::takeImage()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return std::move(m_image);
+}
+
+void Texture::setUploaded(int width, int height, unsigned int level, std::size_t memorySize)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_state = State::Ready;
+	m_uploadQueued = false;
+	m_width = width;
+	m_height = height;
+	m_level = level;
+	m_memorySize = memorySize;
 }
 
 void Texture::init()
 {
-	if (m_contents)
+	const auto currentState = state();
+	if (currentState == State::Empty) // Nothing to show
+		return;
+
+	if (!m_textureId)
 	{
-		glGenTextures(1, &m_textureId);
+		// A single gray texel is shown until the image is uploaded, the texture object is the same
+		const unsigned char placeholder[] = { 128, 128, 128, 255 };
+		m_textureId.create();
 		glBindTexture(GL_TEXTURE_2D, m_textureId);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 
-			m_contents->width, m_contents->height, 0, 
-			m_contents->hasAlpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, &m_contents->contents[0]);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
 		glBindTexture(GL_TEXTURE_2D, 0);
+		TextureResidency::instance().add(shared_from_this());
+	}
+
+	// Not again for a texture shared by multiple materials
+	if (!m_uploadQueued && (currentState == State::Decoding || currentState == State::Decoded))
+	{
+		m_uploadQueued = true;
+		TextureLoader::instance().addUpload(shared_from_this());
 	}
-	m_contents.reset();
 }
 
 unsigned int Texture::id() const
@@ -73,4 +485,58 @@ unsigned int Texture::id() const
 	return m_textureId;
 }
 
+Texture::State Texture::state() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_state;
+}
+
+int Texture::width() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_width;
+}
+
+int Texture::height() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_height;
+}
+
+std::size_t Texture::memorySize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_memorySize;
+}
+
+bool Texture::reloadable() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sourceContents || !m_sourcePath.empty();
+}
+
+bool Texture::loading() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_uploadQueued || m_state == State::Decoding || m_state == State::Decoded;
+}
+
+unsigned int Texture::level() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_level;
+}
+
+int Texture::sourceWidth() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sourceWidth;
+}
+
+int Texture::sourceHeight() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sourceHeight;
+}
+
 } // namespace simplerender
@@ -1,40 +1,90 @@
 #pragma once
 
+#include <render/GLResources.h>
+
+#include <cstddef>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace simplerender
 {
 
-// To destroy the texture object only when every copy is destroyed
-class TextureId;
+const std::size_t defaultTextureCacheSize = 1024 * 1024 * 1024; // Bytes of the files of the decoded textures on disk
 
-class Texture
+// The image is uploaded by the TextureLoader over the next frames, the texture must be owned by a shared_ptr
+class Texture : public std::enable_shared_from_this<Texture>
 {
 public:
-	~Texture();
+	enum class State { Empty, Decoding, Decoded, Ready, Failed };
+
+	// Decoded pixels or mapped cache file, given to the upload without being copied
+	struct Image
+	{
+		std::shared_ptr<const unsigned char> pixels;
+		int width = 0, height = 0, channels = 0;
+		unsigned int level = 0; // Mip level of the source image that the pixels represent
+		std::vector<std::size_t> mipmaps; // Offsets in the pixels of the next levels, if they are not generated by the GPU
 
-	void init(); // Takes the loaded image and creates an OpenGL texture
+		std::size_t levelSize(unsigned int mipmap) const; // In bytes, the mipmap 0 being this image
+		std::size_t size() const; // In bytes, with the mipmaps
+	};
 
-	// These two methods open an image and store it in a buffer inside this class. Init must then be called (with a valid OpenGL context)
+	void init(); // Creates the OpenGL texture, containing a placeholder until the image is uploaded
+
+	// The images decoded from a source are saved in this directory with their mip chain, then mapped in memory instead of being decoded again
+	static void setCacheDirectory(const std::string& directory); // Disabled if empty
+	static const std::string& cacheDirectory();
+	static void setCacheSize(std::size_t size); // In bytes, the least recently used files are removed above it
+	static std::size_t cacheSize();
+
+	// These methods open an image and decode it in the calling thread. Init must then be called (with a valid OpenGL context)
 	bool loadFromFile(const std::string& path);
 	bool loadFromMemory(const std::vector<unsigned char>& fileContents);
 
+	// Same, but the image is decoded by a worker of the TextureLoader (the state is Failed if it cannot be)
+	void loadFromFileAsync(const std::string& path);
+	void loadFromMemoryAsync(const std::vector<unsigned char>& fileContents);
+
 	void setContents(const std::vector<unsigned char>& contents, int width, int height, bool hasAlpha = false);
 
 	unsigned int id() const;
+	State state() const;
+	int width() const; // Of the uploaded image
+	int height() const;
+	std::size_t memorySize() const; // Estimated size on the GPU, with the mipmaps (0 before the upload)
+
+	// Streaming of the mip levels (see TextureResidency), the level 0 being the source image
+	bool reloadable() const; // If the source can be decoded again (not for the contents given directly)
+	void reload(unsigned int level); // Decode the source again, reduced to this level, then upload it. From the OpenGL thread, if the texture is initialized
+	bool loading() const; // If an image is being decoded or uploaded
+	unsigned int level() const; // Of the uploaded image
+	int sourceWidth() const; // Of the level 0 (0 before it is decoded)
+	int sourceHeight() const;
 
 protected:
-	unsigned int m_textureId = 0;
+	friend class TextureLoader;
 
-	struct TextureContents
-	{
-		std::vector<unsigned char> contents;
-		int width = 0, height = 0;
-		bool hasAlpha = false;
-	};
-	std::unique_ptr<TextureContents> m_contents;
+	void setSource(const std::string& path, const std::shared_ptr<const std::vector<unsigned char>>& contents);
+	void decodeAsync(unsigned int level);
+	void setImage(Image image); // From any thread, the texture fails if the image is empty
+	Image takeImage(); // For the upload, if the image is decoded
+	void setUploaded(int width, int height, unsigned int level, std::size_t memorySize);
+
+	TextureHandle m_textureId;
+	bool m_uploadQueued = false; // Only accessed by the OpenGL thread
+
+	mutable std::mutex m_mutex; // The decoding can be done in another thread
+	State m_state = State::Empty;
+	Image m_image;
+	int m_width = 0, m_height = 0;
+	unsigned int m_level = 0;
+	std::size_t m_memorySize = 0;
+
+	std::string m_sourcePath; // Or the contents of the file, to decode the image again
+	std::shared_ptr<const std::vector<unsigned char>> m_sourceContents;
+	int m_sourceWidth = 0, m_sourceHeight = 0;
 };
 
 } // namespace simplerender
@@ -0,0 +1,151 @@
+#include <render/FileCache.h>
+#include <render/TextureCache.h>
+#include <render/Texture.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+#ifndef _WIN32
+#include <climits>
+#endif
+
+namespace
+{
+
+// Absolute path without the "." and ".." components, so that the different writings of a path share their texture
+std::string canonicalPath(const std::string& path)
+{
+#ifdef _WIN32
+	char buffer[_MAX_PATH];
+	std::string result = _fullpath(buffer, path.c_str(), _MAX_PATH) ? buffer : path;
+	std::replace(result.begin(), result.end(), '\\', '/');
+	std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { // Case insensitive file system
+		return static_cast<char>(std::tolower(c));
+	});
+	return result;
+#else
+	char buffer[PATH_MAX];
+	return realpath(path.c_str(), buffer) ? std::string(buffer) : path;
+#endif
+}
+
+std::string contentsKey(const std::vector<unsigned char>& contents)
+{
+	const auto hash = simplerender::hashData(contents.data(), contents.size());
+
+	std::ostringstream key;
+	key << "data:" << std::hex << std::setw(16) << std::setfill('0') << hash << ":" << std::dec << contents.size();
+	return key.str();
+}
+
+}
+
+namespace simplerender
+{
+
+TextureCache& TextureCache::instance()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::TexturePtr TextureCache::fromFile(const std::string& path)
+{
+	// Also used by the texture to find its cache file
+	const auto canonical = canonicalPath(path);
+	return get("file:" + canonical, [&canonical](Texture& texture) {
+		texture.loadFromFileAsync(canonical);
+		return true;
+	});
+}
+
+TextureCache::TexturePtr TextureCache::fromMemory(const std::vector<unsigned char>& fileContents)
+{
+	if (fileContents.empty())
+		return nullptr;
+
+	return get(contentsKey(fileContents), [&fileContents](Texture& texture) {
+		texture.loadFromMemoryAsync(fileContents);
+		return true;
+	});
+}
+
+TextureCache::TexturePtr TextureCache::get(const std::string& key, const LoadFunc& load)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_textures.find(key);
+		if (it != m_textures.end())
+		{
+			if (auto texture = it->second.lock())
+			{
+				++m_statistics.hits;
+				return texture;
+			}
+		}
+	}
+
+	// The image is decoded by the workers of the TextureLoader
+	auto texture = std::make_shared<Texture>();
+	if (!load(*texture))
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Another thread may have loaded the same image
+	auto& entry = m_textures[key];
+	if (auto existing = entry.lock())
+	{
+		++m_statistics.hits;
+		return existing;
+	}
+
+	++m_statistics.misses;
+	entry = texture;
+	removeExpired();
+	return texture;
+}
+
+TextureCache::Statistics TextureCache::statistics()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	removeExpired();
+
+	auto stats = m_statistics;
+	stats.textures = m_textures.size();
+	for (const auto& entry : m_textures)
+	{
+		if (auto texture = entry.second.lock())
+		{
+			stats.memory += texture->memorySize();
+			const auto state = texture->state();
+			if (state == Texture::State::Failed)
+				++stats.failures;
+			else if (state != Texture::State::Ready)
+				++stats.loading;
+		}
+	}
+	return stats;
+}
+
+void TextureCache::resetCounters()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_statistics.hits = m_statistics.misses = 0;
+}
+
+void TextureCache::removeExpired()
+{
+	for (auto it = m_textures.begin(); it != m_textures.end();)
+	{
+		if (it->second.expired())
+			it = m_textures.erase(it);
+		else
+			++it;
+	}
+}
+
+} // namespace simplerender
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simplerender
+{
+
+class Texture;
+
+// Shares the textures loaded from the same file (by canonical path) or from the same contents (by hash)
+// The cache only keeps weak references, a texture is destroyed when the last material using it releases it
+class TextureCache
+{
+public:
+	using TexturePtr = std::shared_ptr<Texture>;
+
+	struct Statistics
+	{
+		std::size_t hits = 0, misses = 0; // Requests of a texture already loaded, or not
+		std::size_t textures = 0; // Currently alive
+		std::size_t loading = 0; // Alive textures being decoded or uploaded
+		std::size_t failures = 0; // Alive textures whose image could not be decoded (drawn with the placeholder)
+		std::size_t memory = 0; // Estimated size on the GPU of the alive textures, in bytes
+	};
+
+	static TextureCache& instance();
+
+	// On a miss, the image is decoded in the background (see TextureLoader), the returned texture must be initialized with an OpenGL context
+	TexturePtr fromFile(const std::string& path);
+	TexturePtr fromMemory(const std::vector<unsigned char>& fileContents);
+
+	Statistics statistics();
+	void resetCounters(); // Hits and misses
+
+protected:
+	using LoadFunc = std::function<bool(Texture&)>;
+
+	TexturePtr get(const std::string& key, const LoadFunc& load); // Calls load on a miss, returns null if it fails
+	void removeExpired(); // Must be called with the mutex locked
+
+	std::mutex m_mutex;
+	std::unordered_map<std::string, std::weak_ptr<Texture>> m_textures;
+	Statistics m_statistics; // Only the counters, the others are computed by statistics()
+};
+
+} // namespace simplerender
@@ -0,0 +1,208 @@
+#include <render/TextureLoader.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+
+struct PixelFormat
+{
+	GLint internalFormat;
+	GLenum format;
+	GLint swizzle[4]; // The gray images are expanded by the sampler
+};
+
+const PixelFormat& pixelFormat(int channels)
+{
+	static const PixelFormat formats[] = {
+		{ GL_R8, GL_RED, { GL_RED, GL_RED, GL_RED, GL_ONE } },
+		{ GL_RG8, GL_RG, { GL_RED, GL_RED, GL_RED, GL_GREEN } },
+		{ GL_RGB8, GL_RGB, { GL_RED, GL_GREEN, GL_BLUE, GL_ONE } },
+		{ GL_RGBA8, GL_RGBA, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } }
+	};
+	return formats[std::min(std::max(channels, 1), 4) - 1];
+}
+
+// The drivers store RGB textures with 4 bytes per texel, and the mipmaps add a third (wherever they come from)
+std::size_t textureMemory(const simplerender::Texture::Image& image)
+{
+	const std::size_t texelSize = (image.channels == 3) ? 4 : image.channels;
+	return static_cast<std::size_t>(image.width) * image.height * texelSize * 4 / 3;
+}
+
+unsigned int maxWorkers()
+{
+	// Keep a core for the UI and the render
+	const auto nbThreads = std::thread::hardware_concurrency();
+	return nbThreads > 1 ? nbThreads - 1 : 1;
+}
+
+}
+
+namespace simplerender
+{
+
+TextureLoader& TextureLoader::instance()
+{
+	static TextureLoader loader;
+	return loader;
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_jobs.clear();
+	}
+
+	for (auto& worker : m_workers)
+		worker.wait();
+}
+
+void TextureLoader::decode(const Job& job)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_jobs.push_back(job);
+	if (m_activeWorkers >= maxWorkers())
+		return;
+
+	// Forget the workers that have stopped
+	m_workers.erase(std::remove_if(m_workers.begin(), m_workers.end(), [](const std::future<void>& worker) {
+		return worker.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), m_workers.end());
+
+	++m_activeWorkers;
+	m_workers.push_back(std::async(std::launch::async, [this]() { work(); }));
+}
+
+void TextureLoader::work()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_jobs.empty() || m_stopping)
+			{
+				--m_activeWorkers;
+				return;
+			}
+
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+void TextureLoader::addUpload(const std::shared_ptr<Texture>& texture)
+{
+	Upload upload;
+	upload.texture = texture;
+	m_uploads.push_back(std::move(upload));
+}
+
+void TextureLoader::processUploads()
+{
+	if (m_uploads.empty())
+		return;
+
+	// The pixel buffers filled by the previous call have had a frame to be transferred
+	for (auto& upload : m_uploads)
+	{
+		if (!upload.staged)
+			continue;
+
+		auto texture = upload.texture.lock();
+		if (texture)
+		{
+			const auto& image = upload.image;
+			const auto& format = pixelFormat(image.channels);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+			glBindTexture(GL_TEXTURE_2D, texture->id());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, format.internalFormat, image.width, image.height, 0, format.format, GL_UNSIGNED_BYTE, nullptr);
+
+			// The mipmaps of the cache files follow the image in the pixel buffer
+			const auto nbMipmaps = static_cast<GLint>(image.mipmaps.size());
+			for (GLint i = 1; i <= nbMipmaps; ++i)
+				glTexImage2D(GL_TEXTURE_2D, i, format.internalFormat, std::max(image.width >> i, 1), std::max(image.height >> i, 1), 0,
+					format.format, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid*>(image.mipmaps[i - 1]));
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nbMipmaps ? nbMipmaps : 1000); // 1000 is the default
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+			if (!nbMipmaps)
+				glGenerateMipmap(GL_TEXTURE_2D);
+			texture->setUploaded(image.width, image.height, image.level, textureMemory(image));
+		}
+
+		upload.texture.reset(); // Done
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	m_uploads.erase(std::remove_if(m_uploads.begin(), m_uploads.end(), [](const Upload& upload) {
+		return upload.texture.expired();
+	}), m_uploads.end());
+
+	// Copy the decoded images to pixel buffers, in the order of the requests
+	std::size_t bytes = 0;
+	for (auto& upload : m_uploads)
+	{
+		auto texture = upload.texture.lock();
+		if (!texture)
+			continue;
+
+		if (!upload.image.pixels)
+		{
+			const auto state = texture->state();
+			if (state == Texture::State::Failed)
+				upload.texture.reset();
+			if (state != Texture::State::Decoded)
+				continue;
+
+			upload.image = texture->takeImage();
+		}
+
+		const auto size = upload.image.size();
+		if (bytes && bytes + size > m_uploadBudget)
+			break;
+
+		upload.pbo.create();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		auto ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (!ptr)
+		{
+			upload.pbo.reset();
+			continue;
+		}
+
+		std::memcpy(ptr, upload.image.pixels.get(), size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		upload.image.pixels.reset(); // The size, channels, level and mipmaps are kept for the transfer
+		upload.staged = true;
+		bytes += size;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	m_uploads.erase(std::remove_if(m_uploads.begin(), m_uploads.end(), [](const Upload& upload) {
+		return upload.texture.expired();
+	}), m_uploads.end());
+}
+
+bool TextureLoader::busy()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return !m_jobs.empty() || m_activeWorkers || !m_uploads.empty();
+}
+
+} // namespace simplerender
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <render/GLResources.h>
+#include <render/Texture.h>
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace simplerender
+{
+
+const std::size_t defaultTextureUploadBudget = 16 * 1024 * 1024; // Bytes copied to pixel buffers per frame
+
+// Decodes the images with a pool of worker threads, and uploads them on the OpenGL thread through pixel buffers, spread over the frames
+class TextureLoader
+{
+public:
+	static TextureLoader& instance();
+	~TextureLoader(); // Drops the queued decodings and waits for the running ones
+
+	using Job = std::function<void()>;
+	void decode(const Job& job); // Run by one of the workers
+
+	void addUpload(const std::shared_ptr<Texture>& texture); // Uploaded when its image is decoded, the texture must be initialized
+
+	// Must be called with the OpenGL context current (done at the beginning of Scene::render)
+	// The pixel buffers filled by the previous call are copied to their textures, then the next decoded images are copied to pixel buffers (up to the budget)
+	void processUploads();
+
+	void setUploadBudget(std::size_t bytes); // At least one image is staged at each call
+	std::size_t uploadBudget() const;
+
+	bool busy(); // If images are being decoded or uploaded (the view must be updated until it is not)
+
+protected:
+	void work(); // Loop of a worker, until there are no more jobs
+
+	struct Upload
+	{
+		std::weak_ptr<Texture> texture;
+		Texture::Image image; // Taken from the texture when it is decoded
+		BufferHandle pbo; // Filled with the image, copied to the texture by the next call
+		bool staged = false;
+	};
+
+	std::mutex m_mutex;
+	std::deque<Job> m_jobs;
+	std::vector<std::future<void>> m_workers;
+	unsigned int m_activeWorkers = 0;
+	bool m_stopping = false;
+
+	std::vector<Upload> m_uploads; // Only accessed by the OpenGL thread
+	std::size_t m_uploadBudget = defaultTextureUploadBudget;
+};
+
+//****************************************************************************//
+
+inline void TextureLoader::setUploadBudget(std::size_t bytes)
+{ m_uploadBudget = bytes; }
+
+inline std::size_t TextureLoader::uploadBudget() const
+{ return m_uploadBudget; }
+
+} // namespace simplerender
@@ -0,0 +1,209 @@
+#include <render/TextureResidency.h>
+#include <render/Texture.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+const int minimumLevelSize = 64; // The levels are not dropped under this size, in texels
+const unsigned int maxReloadsPerFrame = 4; // The others are started at the next frames
+
+// Each level has a quarter of the texels of the previous one
+std::size_t memoryAt(std::size_t memory, unsigned int from, unsigned int to)
+{
+	if (to < from)
+		return memory << (2 * (from - to));
+	return memory >> (2 * (to - from));
+}
+
+// Finest level not smaller than the size on screen
+unsigned int neededLevel(int sourceSize, float screenSize)
+{
+	const float ratio = sourceSize / std::max(screenSize, 1.f);
+	return ratio > 1.f ? static_cast<unsigned int>(std::floor(std::log2(ratio))) : 0;
+}
+
+unsigned int coarsestLevel(int sourceSize)
+{
+	unsigned int level = 0;
+	while ((sourceSize >> (level + 1)) >= minimumLevelSize)
+		++level;
+	return level;
+}
+
+}
+
+namespace simplerender
+{
+
+TextureResidency& TextureResidency::instance()
+{
+	static TextureResidency residency;
+	return residency;
+}
+
+TextureResidency::Entry& TextureResidency::entry(const std::shared_ptr<Texture>& texture)
+{
+	// A destroyed texture can have left an entry at the same address
+	auto& entry = m_entries[texture.get()];
+	if (entry.texture.lock() != texture)
+	{
+		entry = Entry();
+		entry.texture = texture;
+	}
+	return entry;
+}
+
+void TextureResidency::add(const std::shared_ptr<Texture>& texture)
+{
+	entry(texture);
+}
+
+void TextureResidency::use(const std::shared_ptr<Texture>& texture, float screenSize)
+{
+	auto& used = entry(texture);
+	if (used.lastUsed != m_frame)
+	{
+		used.lastUsed = m_frame;
+		used.screenSize = 0;
+	}
+	used.screenSize = std::max(used.screenSize, screenSize);
+}
+
+void TextureResidency::update()
+{
+	struct Candidate
+	{
+		std::shared_ptr<Texture> texture;
+		unsigned int lastUsed = 0;
+		unsigned int level = 0, needed = 0, coarsest = 0; // The first one is the level chosen
+		std::size_t memory = 0; // At the chosen level
+	};
+	std::vector<Candidate> candidates;
+
+	Statistics stats;
+	stats.budget = m_budget;
+	std::size_t memory = 0; // With the chosen levels
+	for (auto it = m_entries.begin(); it != m_entries.end();)
+	{
+		auto texture = it->second.texture.lock();
+		if (!texture)
+		{
+			it = m_entries.erase(it);
+			continue;
+		}
+
+		const auto& entry = it->second;
+		++it;
+
+		const auto textureMemory = texture->memorySize();
+		stats.memory += textureMemory;
+		++stats.textures;
+		if (texture->loading())
+		{
+			++stats.loading;
+			memory += textureMemory;
+			continue;
+		}
+
+		const int sourceSize = std::max(texture->sourceWidth(), texture->sourceHeight());
+		if (!textureMemory || !sourceSize || !texture->reloadable()) // Its level cannot change
+		{
+			memory += textureMemory;
+			continue;
+		}
+
+		// The levels are only dropped if the budget is exceeded, to not reload the textures at each zoom
+		Candidate candidate;
+		candidate.texture = texture;
+		candidate.lastUsed = entry.lastUsed;
+		candidate.level = texture->level();
+		candidate.coarsest = std::max(coarsestLevel(sourceSize), candidate.level);
+		candidate.needed = (entry.lastUsed == m_frame) ? std::min(neededLevel(sourceSize, entry.screenSize), candidate.coarsest) : candidate.coarsest;
+		const auto level = std::min(candidate.level, candidate.needed);
+		candidate.memory = memoryAt(textureMemory, candidate.level, level);
+		candidate.level = level;
+		memory += candidate.memory;
+		candidates.push_back(std::move(candidate));
+	}
+
+	if (memory > m_budget)
+	{
+		// First drop the levels finer than needed
+		for (auto& candidate : candidates)
+		{
+			if (candidate.level < candidate.needed && candidate.lastUsed == m_frame)
+			{
+				const auto reduced = memoryAt(candidate.memory, candidate.level, candidate.needed);
+				memory -= candidate.memory - reduced;
+				candidate.memory = reduced;
+				candidate.level = candidate.needed;
+			}
+		}
+
+		// Then one level at a time for the textures unused for the longest time, starting with the largest ones
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+			return lhs.lastUsed != rhs.lastUsed ? lhs.lastUsed < rhs.lastUsed : lhs.memory > rhs.memory;
+		});
+
+		for (auto first = candidates.begin(); memory > m_budget && first != candidates.end();)
+		{
+			const auto last = std::find_if(first, candidates.end(), [first](const Candidate& candidate) {
+				return candidate.lastUsed != first->lastUsed;
+			});
+
+			for (bool reduced = true; reduced && memory > m_budget;)
+			{
+				reduced = false;
+				for (auto it = first; it != last && memory > m_budget; ++it)
+				{
+					if (it->level >= it->coarsest)
+						continue;
+
+					const auto quarter = it->memory / 4;
+					memory -= it->memory - quarter;
+					it->memory = quarter;
+					++it->level;
+					reduced = true;
+				}
+			}
+
+			first = last;
+		}
+	}
+
+	unsigned int reloads = 0;
+	for (const auto& candidate : candidates)
+	{
+		if (candidate.lastUsed == m_frame && candidate.level > candidate.needed)
+			++stats.reduced;
+
+		if (candidate.level != candidate.texture->level() && reloads < maxReloadsPerFrame)
+		{
+			candidate.texture->reload(candidate.level);
+			++reloads;
+		}
+	}
+
+	m_statistics = stats;
+	++m_frame;
+}
+
+std::string statusText(const TextureResidency::Statistics& stats)
+{
+	const double megabyte = 1024 * 1024;
+	std::ostringstream text;
+	text << std::fixed << std::setprecision(0) << "Textures: " << stats.memory / megabyte << " / " << stats.budget / megabyte << " MB";
+	if (stats.reduced)
+		text << " (" << stats.reduced << " reduced)";
+	if (stats.loading)
+		text << " (" << stats.loading << " loading)";
+	return text.str();
+}
+
+} // namespace simplerender
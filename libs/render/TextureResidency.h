@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace simplerender
+{
+
+class Texture;
+
+const std::size_t defaultTextureBudget = 512 * 1024 * 1024; // Bytes of the uploaded textures, with their mipmaps
+
+// Chooses the finest mip level uploaded for each texture, so that their memory stays under a budget
+// The textures drawn in a frame get the level needed at their size on screen, and when the budget is exceeded
+// the levels of the least recently used ones are dropped first. The images are decoded again from their source to change levels.
+// Everything is done in the OpenGL thread
+class TextureResidency
+{
+public:
+	static TextureResidency& instance();
+
+	void add(const std::shared_ptr<Texture>& texture); // Done by Texture::init
+	void use(const std::shared_ptr<Texture>& texture, float screenSize); // Drawn this frame, over this number of pixels (the largest call is kept)
+	void update(); // At each frame, after the calls to use: start the reloads of the textures whose level must change
+
+	void setBudget(std::size_t bytes);
+	std::size_t budget() const;
+
+	struct Statistics
+	{
+		std::size_t budget = 0;
+		std::size_t memory = 0; // Of the uploaded textures
+		std::size_t textures = 0;
+		std::size_t reduced = 0; // Textures drawn this frame with a coarser level than needed, because of the budget
+		std::size_t loading = 0; // Textures being decoded or uploaded
+	};
+	const Statistics& statistics() const; // Computed by update
+
+protected:
+	struct Entry
+	{
+		std::weak_ptr<Texture> texture;
+		unsigned int lastUsed = 0; // Frame
+		float screenSize = 0;
+	};
+
+	Entry& entry(const std::shared_ptr<Texture>& texture);
+
+	std::unordered_map<const Texture*, Entry> m_entries;
+	unsigned int m_frame = 1;
+	std::size_t m_budget = defaultTextureBudget;
+	Statistics m_statistics;
+};
+
+std::string statusText(const TextureResidency::Statistics& stats); // For the status bar
+
+//****************************************************************************//
+
+inline void TextureResidency::setBudget(std::size_t bytes)
+{ m_budget = bytes; }
+
+inline std::size_t TextureResidency::budget() const
+{ return m_budget; }
+
+inline const TextureResidency::Statistics& TextureResidency::statistics() const
+{ return m_statistics; }
+
+} // namespace simplerender
@@ -0,0 +1,157 @@
+#include <render/TransformHierarchy.h>
+
+#include <algorithm>
+
+namespace simplerender
+{
+
+const TransformHierarchy::Index TransformHierarchy::invalid;
+
+void TransformHierarchy::clear()
+{
+	m_locals.clear();
+	m_worlds.clear();
+	m_parents.clear();
+	m_firstChild.clear();
+	m_nextSibling.clear();
+	m_previousSibling.clear();
+	m_depths.clear();
+	m_used.clear();
+	m_dirty.clear();
+	m_dirtyNodes.clear();
+	m_freeSlots.clear();
+}
+
+TransformHierarchy::Index TransformHierarchy::add(Index parent)
+{
+	Index index;
+	if (!m_freeSlots.empty())
+	{
+		index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		index = static_cast<Index>(m_locals.size());
+		m_locals.emplace_back();
+		m_worlds.emplace_back();
+		m_parents.push_back(invalid);
+		m_firstChild.push_back(invalid);
+		m_nextSibling.push_back(invalid);
+		m_previousSibling.push_back(invalid);
+		m_depths.push_back(0);
+		m_used.push_back(0);
+		m_dirty.push_back(0);
+	}
+
+	m_locals[index] = glm::mat4(1.f);
+	m_parents[index] = parent;
+	m_firstChild[index] = invalid;
+	m_previousSibling[index] = invalid;
+	m_nextSibling[index] = invalid;
+	m_used[index] = 1;
+	m_dirty[index] = 0;
+
+	if (parent != invalid)
+	{
+		m_depths[index] = m_depths[parent] + 1;
+		const auto first = m_firstChild[parent];
+		m_nextSibling[index] = first;
+		if (first != invalid)
+			m_previousSibling[first] = index;
+		m_firstChild[parent] = index;
+	}
+	else
+		m_depths[index] = 0;
+
+	setLocal(index, m_locals[index]); // The world transformation is computed by the next update
+	return index;
+}
+
+void TransformHierarchy::remove(Index index)
+{
+	if (!valid(index))
+		return;
+
+	unlink(index);
+
+	// Free the slots of the whole subtree
+	m_stack.clear();
+	m_stack.push_back(index);
+	while (!m_stack.empty())
+	{
+		const auto current = m_stack.back();
+		m_stack.pop_back();
+		for (auto child = m_firstChild[current]; child != invalid; child = m_nextSibling[child])
+			m_stack.push_back(child);
+
+		m_used[current] = 0;
+		m_dirty[current] = 0; // Ignored if still in m_dirtyNodes
+		m_parents[current] = invalid;
+		m_firstChild[current] = invalid;
+		m_freeSlots.push_back(current);
+	}
+}
+
+void TransformHierarchy::unlink(Index index)
+{
+	const auto parent = m_parents[index];
+	const auto previous = m_previousSibling[index], next = m_nextSibling[index];
+	if (previous != invalid)
+		m_nextSibling[previous] = next;
+	else if (parent != invalid)
+		m_firstChild[parent] = next;
+
+	if (next != invalid)
+		m_previousSibling[next] = previous;
+
+	m_previousSibling[index] = m_nextSibling[index] = invalid;
+}
+
+void TransformHierarchy::setLocal(Index index, const glm::mat4& local)
+{
+	m_locals[index] = local;
+	if (!m_dirty[index])
+	{
+		m_dirty[index] = 1;
+		m_dirtyNodes.push_back(index);
+	}
+}
+
+void TransformHierarchy::update(Indices& modified)
+{
+	modified.clear();
+	if (m_dirtyNodes.empty())
+		return;
+
+	// Parents first, so that a subtree containing other modified nodes is only computed once
+	std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end(), [this](Index lhs, Index rhs) {
+		return m_depths[lhs] < m_depths[rhs];
+	});
+
+	for (auto root : m_dirtyNodes)
+	{
+		if (!m_used[root] || !m_dirty[root]) // Removed, or already computed with an ancestor
+			continue;
+
+		m_stack.clear();
+		m_stack.push_back(root);
+		while (!m_stack.empty())
+		{
+			const auto index = m_stack.back();
+			m_stack.pop_back();
+
+			const auto parent = m_parents[index];
+			m_worlds[index] = (parent != invalid) ? m_worlds[parent] * m_locals[index] : m_locals[index];
+			m_dirty[index] = 0;
+			modified.push_back(index);
+
+			for (auto child = m_firstChild[index]; child != invalid; child = m_nextSibling[child])
+				m_stack.push_back(child);
+		}
+	}
+
+	m_dirtyNodes.clear();
+}
+
+} // namespace simplerender
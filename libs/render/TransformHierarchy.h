@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace simplerender
+{
+
+// Local and world transformations of a tree of nodes, stored contiguously
+// Only the subtrees of the nodes whose local transformation was modified are recomputed by update
+class TransformHierarchy
+{
+public:
+	using Index = unsigned int;
+	using Indices = std::vector<Index>;
+	static const Index invalid = static_cast<Index>(-1);
+
+	void clear();
+	Index add(Index parent = invalid); // With an identity local transformation (may reuse the slot of a removed node)
+	void remove(Index index); // With all its descendants
+
+	void setLocal(Index index, const glm::mat4& local); // Marks the subtree for the next update
+	const glm::mat4& local(Index index) const;
+	const glm::mat4& world(Index index) const; // Valid after update
+	Index parent(Index index) const;
+	bool valid(Index index) const; // If the slot is used
+
+	void update(Indices& modified); // Fills modified with every node whose world transformation was recomputed
+	bool needsUpdate() const;
+
+protected:
+	void unlink(Index index); // From the children of its parent
+
+	std::vector<glm::mat4> m_locals, m_worlds;
+	Indices m_parents, m_firstChild, m_nextSibling, m_previousSibling;
+	std::vector<unsigned int> m_depths;
+	std::vector<char> m_used, m_dirty;
+	Indices m_dirtyNodes, m_freeSlots;
+	Indices m_stack; // Used by update and remove
+};
+
+//****************************************************************************//
+
+inline const glm::mat4& TransformHierarchy::local(Index index) const
+{ return m_locals[index]; }
+
+inline const glm::mat4& TransformHierarchy::world(Index index) const
+{ return m_worlds[index]; }
+
+inline TransformHierarchy::Index TransformHierarchy::parent(Index index) const
+{ return m_parents[index]; }
+
+inline bool TransformHierarchy::valid(Index index) const
+{ return index < m_used.size() && m_used[index]; }
+
+inline bool TransformHierarchy::needsUpdate() const
+{ return !m_dirtyNodes.empty(); }
+
+} // namespace simplerender
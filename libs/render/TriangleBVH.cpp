@@ -0,0 +1,381 @@
+#include <render/TriangleBVH.h>
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <thread>
+
+namespace
+{
+
+const unsigned int maxLeafSize = 4; // A node with more triangles is always split
+const unsigned int nbBins = 16; // Candidate planes for the surface area heuristic
+const unsigned int minParallelCount = 16384; // Smaller subtrees are built by the calling thread
+const unsigned int minRefitChunkSize = 4096; // Of leaves
+
+inline float halfArea(const glm::vec3& min, const glm::vec3& max)
+{
+	const auto extent = max - min;
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+int parallelDepth()
+{
+	// Each level doubles the number of tasks
+	int depth = 0;
+	for (unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency()); nbThreads > 1; nbThreads /= 2)
+		++depth;
+	return depth;
+}
+
+// Calls func(first, last) on chunks of [0, count[, the first one in the calling thread and the others asynchronously
+template <class Func>
+void parallelFor(unsigned int count, Func func)
+{
+	const unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned int nbChunks = std::min(nbThreads, (count + minRefitChunkSize - 1) / minRefitChunkSize);
+	if (nbChunks <= 1)
+	{
+		func(0u, count);
+		return;
+	}
+
+	const unsigned int chunkSize = (count + nbChunks - 1) / nbChunks;
+	std::vector<std::future<void>> futures;
+	for (unsigned int first = chunkSize; first < count; first += chunkSize)
+		futures.push_back(std::async(std::launch::async, func, first, std::min(count, first + chunkSize)));
+
+	func(0u, chunkSize);
+	for (auto& future : futures)
+		future.get();
+}
+
+}
+
+namespace simplerender
+{
+
+void TriangleBVH::build(const Positions& vertices, const Triangles& triangles)
+{
+	clear();
+	const auto nbTriangles = static_cast<unsigned int>(triangles.size());
+	if (!nbTriangles)
+		return;
+
+	m_boxes.resize(nbTriangles);
+	m_centers.resize(nbTriangles);
+	m_trianglesIds.resize(nbTriangles);
+	for (unsigned int i = 0; i < nbTriangles; ++i)
+	{
+		const auto& triangle = triangles[i];
+		const auto &p0 = vertices[triangle[0]], &p1 = vertices[triangle[1]], &p2 = vertices[triangle[2]];
+		auto& box = m_boxes[i];
+		box.first = glm::min(p0, glm::min(p1, p2));
+		box.second = glm::max(p0, glm::max(p1, p2));
+		m_centers[i] = (box.first + box.second) * 0.5f;
+		m_trianglesIds[i] = i;
+	}
+
+	m_nodes.reserve(2 * nbTriangles / maxLeafSize + 1);
+	m_nodes.emplace_back();
+	buildNode(m_nodes, 0, 0, nbTriangles, 0);
+
+	// Copy the triangles in the order of the leaves, for the refit and the intersections
+	m_triangles.resize(nbTriangles);
+	for (unsigned int i = 0; i < nbTriangles; ++i)
+		m_triangles[i] = triangles[m_trianglesIds[i]];
+
+	for (unsigned int i = 0, nb = static_cast<unsigned int>(m_nodes.size()); i < nb; ++i)
+	{
+		if (m_nodes[i].count)
+			m_leaves.push_back(i);
+	}
+
+	BVH::BoundingBoxes().swap(m_boxes);
+	std::vector<glm::vec3>().swap(m_centers);
+}
+
+void TriangleBVH::refit(const Positions& vertices)
+{
+	if (m_nodes.empty())
+		return;
+
+	parallelFor(static_cast<unsigned int>(m_leaves.size()), [this, &vertices](unsigned int first, unsigned int last) {
+		for (unsigned int i = first; i < last; ++i)
+			updateLeaf(m_nodes[m_leaves[i]], vertices);
+	});
+
+	// Children are after their parent
+	for (auto it = m_nodes.rbegin(), itEnd = m_nodes.rend(); it != itEnd; ++it)
+	{
+		auto& node = *it;
+		if (node.count)
+			continue;
+
+		const auto& left = m_nodes[node.first];
+		const auto& right = m_nodes[node.first + 1];
+		node.min = glm::min(left.min, right.min);
+		node.max = glm::max(left.max, right.max);
+	}
+}
+
+void TriangleBVH::clear()
+{
+	m_nodes.clear();
+	m_triangles.clear();
+	m_trianglesIds.clear();
+	m_leaves.clear();
+}
+
+bool TriangleBVH::intersect(const Positions& vertices, const Ray& ray, float maxDistance, Hit& hit) const
+{
+	if (m_nodes.empty())
+		return false;
+
+	float closest = maxDistance, entry = 0;
+	if (!simplerender::intersect(ray, m_nodes[0].min, m_nodes[0].max, closest, entry))
+		return false;
+
+	bool found = false;
+	std::vector<std::pair<unsigned int, float>> stack; // Node and its entry distance
+	stack.emplace_back(0, entry);
+	while (!stack.empty())
+	{
+		const auto current = stack.back();
+		stack.pop_back();
+		if (current.second > closest) // A closer triangle was found since it was pushed
+			continue;
+
+		const auto& node = m_nodes[current.first];
+		if (!node.count)
+		{
+			// Visit the nearest child first
+			float leftEntry = 0, rightEntry = 0;
+			const bool hitLeft = simplerender::intersect(ray, m_nodes[node.first].min, m_nodes[node.first].max, closest, leftEntry);
+			const bool hitRight = simplerender::intersect(ray, m_nodes[node.first + 1].min, m_nodes[node.first + 1].max, closest, rightEntry);
+			if (hitLeft && hitRight)
+			{
+				if (leftEntry < rightEntry)
+				{
+					stack.emplace_back(node.first + 1, rightEntry);
+					stack.emplace_back(node.first, leftEntry);
+				}
+				else
+				{
+					stack.emplace_back(node.first, leftEntry);
+					stack.emplace_back(node.first + 1, rightEntry);
+				}
+			}
+			else if (hitLeft)
+				stack.emplace_back(node.first, leftEntry);
+			else if (hitRight)
+				stack.emplace_back(node.first + 1, rightEntry);
+			continue;
+		}
+
+		// Möller–Trumbore, both faces
+		for (unsigned int i = node.first, last = node.first + node.count; i < last; ++i)
+		{
+			const auto& triangle = m_triangles[i];
+			const auto& p0 = vertices[triangle[0]];
+			const auto edge1 = vertices[triangle[1]] - p0, edge2 = vertices[triangle[2]] - p0;
+			const auto pVec = glm::cross(ray.direction, edge2);
+			const float det = glm::dot(edge1, pVec);
+			if (det == 0.f) // Parallel or degenerate
+				continue;
+
+			const float invDet = 1.f / det;
+			const auto tVec = ray.origin - p0;
+			const float u = glm::dot(tVec, pVec) * invDet;
+			if (u < 0.f || u > 1.f)
+				continue;
+
+			const auto qVec = glm::cross(tVec, edge1);
+			const float v = glm::dot(ray.direction, qVec) * invDet;
+			if (v < 0.f || u + v > 1.f)
+				continue;
+
+			const float t = glm::dot(edge2, qVec) * invDet;
+			if (t < 0.f || t >= closest)
+				continue;
+
+			closest = t;
+			found = true;
+			hit.distance = t;
+			hit.triangle = m_trianglesIds[i];
+			hit.barycentric = glm::vec3(1.f - u - v, u, v);
+		}
+	}
+
+	return found;
+}
+
+void TriangleBVH::buildNode(Nodes& nodes, unsigned int nodeId, unsigned int first, unsigned int count, int depth)
+{
+	const float maxValue = std::numeric_limits<float>::max();
+	glm::vec3 min(maxValue), max(-maxValue), centersMin(maxValue), centersMax(-maxValue);
+	for (unsigned int i = first, last = first + count; i < last; ++i)
+	{
+		const auto id = m_trianglesIds[i];
+		min = glm::min(min, m_boxes[id].first);
+		max = glm::max(max, m_boxes[id].second);
+		centersMin = glm::min(centersMin, m_centers[id]);
+		centersMax = glm::max(centersMax, m_centers[id]);
+	}
+
+	nodes[nodeId].min = min;
+	nodes[nodeId].max = max;
+
+	const auto nbLeft = split(first, count, nodes[nodeId], centersMin, centersMax);
+	if (!nbLeft)
+	{
+		nodes[nodeId].first = first;
+		nodes[nodeId].count = count;
+		return;
+	}
+
+	static const int maxParallelDepth = parallelDepth();
+	if (depth >= maxParallelDepth || count < minParallelCount)
+	{
+		const auto left = static_cast<unsigned int>(nodes.size());
+		nodes.resize(left + 2);
+		nodes[nodeId].first = left;
+		nodes[nodeId].count = 0;
+		buildNode(nodes, left, first, nbLeft, depth + 1);
+		buildNode(nodes, left + 1, first + nbLeft, count - nbLeft, depth + 1);
+		return;
+	}
+
+	// Build the left subtree in another thread, the two halves of m_trianglesIds being independent
+	Nodes leftNodes(1), rightNodes(1);
+	auto leftTask = std::async(std::launch::async, [&]() {
+		buildNode(leftNodes, 0, first, nbLeft, depth + 1);
+	});
+	buildNode(rightNodes, 0, first + nbLeft, count - nbLeft, depth + 1);
+	leftTask.get();
+
+	const auto left = static_cast<unsigned int>(nodes.size());
+	nodes.resize(left + 2);
+	nodes[nodeId].first = left;
+	nodes[nodeId].count = 0;
+	nodes.reserve(nodes.size() + leftNodes.size() + rightNodes.size());
+	append(nodes, left, leftNodes);
+	append(nodes, left + 1, rightNodes);
+}
+
+unsigned int TriangleBVH::split(unsigned int first, unsigned int count, const Node& node, const glm::vec3& centersMin, const glm::vec3& centersMax)
+{
+	if (count <= 1)
+		return 0;
+
+	const auto extent = centersMax - centersMin;
+	int axis = 0;
+	if (extent.y > extent[axis])
+		axis = 1;
+	if (extent.z > extent[axis])
+		axis = 2;
+
+	const auto begin = m_trianglesIds.begin() + first, end = begin + count;
+	if (extent[axis] <= 0.f) // All the centers are the same, only a leaf size limit
+		return count > maxLeafSize ? count / 2 : 0;
+
+	// Bin the triangles by their center
+	struct Bin
+	{
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+		unsigned int count = 0;
+	};
+	Bin bins[nbBins];
+
+	const float origin = centersMin[axis], scale = nbBins / extent[axis];
+	auto binIndex = [&](unsigned int id) {
+		return std::min(nbBins - 1, static_cast<unsigned int>((m_centers[id][axis] - origin) * scale));
+	};
+
+	for (auto it = begin; it != end; ++it)
+	{
+		auto& bin = bins[binIndex(*it)];
+		bin.min = glm::min(bin.min, m_boxes[*it].first);
+		bin.max = glm::max(bin.max, m_boxes[*it].second);
+		++bin.count;
+	}
+
+	// Cost of the triangles on the right of each plane, then the sweep from the left
+	float rightCosts[nbBins] = {};
+	Bin accumulated;
+	for (unsigned int i = nbBins - 1; i > 0; --i)
+	{
+		accumulated.min = glm::min(accumulated.min, bins[i].min);
+		accumulated.max = glm::max(accumulated.max, bins[i].max);
+		accumulated.count += bins[i].count;
+		rightCosts[i] = accumulated.count ? accumulated.count * halfArea(accumulated.min, accumulated.max) : 0.f;
+	}
+
+	float bestCost = std::numeric_limits<float>::max();
+	unsigned int bestPlane = 0;
+	accumulated = Bin();
+	for (unsigned int i = 1; i < nbBins; ++i)
+	{
+		accumulated.min = glm::min(accumulated.min, bins[i - 1].min);
+		accumulated.max = glm::max(accumulated.max, bins[i - 1].max);
+		accumulated.count += bins[i - 1].count;
+		if (!accumulated.count || accumulated.count == count)
+			continue;
+
+		const float cost = accumulated.count * halfArea(accumulated.min, accumulated.max) + rightCosts[i];
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestPlane = i;
+		}
+	}
+
+	// Traversing a node costs as much as intersecting a triangle
+	const float area = halfArea(node.min, node.max);
+	if (count <= maxLeafSize && (!bestPlane || area + bestCost >= count * area))
+		return 0;
+
+	if (!bestPlane) // Only when the triangles cannot be separated by the bins
+		return count / 2;
+
+	const auto middle = std::partition(begin, end, [&](unsigned int id) {
+		return binIndex(id) < bestPlane;
+	});
+	return static_cast<unsigned int>(middle - begin);
+}
+
+void TriangleBVH::append(Nodes& nodes, unsigned int nodeId, const Nodes& subtree)
+{
+	// The root of the subtree goes to nodeId, the other nodes at the end
+	const auto offset = static_cast<unsigned int>(nodes.size()) - 1;
+	auto moved = [offset](Node node) {
+		if (!node.count)
+			node.first += offset;
+		return node;
+	};
+
+	nodes[nodeId] = moved(subtree[0]);
+	for (unsigned int i = 1, nb = static_cast<unsigned int>(subtree.size()); i < nb; ++i)
+		nodes.push_back(moved(subtree[i]));
+}
+
+void TriangleBVH::updateLeaf(Node& node, const Positions& vertices)
+{
+	const float maxValue = std::numeric_limits<float>::max();
+	glm::vec3 min(maxValue), max(-maxValue);
+	for (unsigned int i = node.first, last = node.first + node.count; i < last; ++i)
+	{
+		for (auto index : m_triangles[i])
+		{
+			min = glm::min(min, vertices[index]);
+			max = glm::max(max, vertices[index]);
+		}
+	}
+
+	node.min = min;
+	node.max = max;
+}
+
+} // namespace simplerender
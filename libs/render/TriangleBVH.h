@@ -0,0 +1,65 @@
+#pragma once
+
+#include <render/BVH.h>
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+
+namespace simplerender
+{
+
+// Hierarchy over the triangles of a mesh, for the ray casts
+// Built with the surface area heuristic (the largest subtrees in parallel), it can be refitted when the vertices move
+class TriangleBVH
+{
+public:
+	using Positions = std::vector<glm::vec3>;
+	using Triangles = std::vector<std::array<unsigned int, 3>>;
+
+	struct Hit
+	{
+		float distance = 0; // In the unit of the ray direction
+		unsigned int triangle = 0; // Index in the list given to build
+		glm::vec3 barycentric; // Weights of the 3 vertices of the triangle
+	};
+
+	void build(const Positions& vertices, const Triangles& triangles);
+	void refit(const Positions& vertices); // After the vertices moved, the triangles being the same
+	void clear();
+	bool empty() const;
+
+	// Closest triangle hit before maxDistance, the vertices must be the ones given to the last build or refit
+	bool intersect(const Positions& vertices, const Ray& ray, float maxDistance, Hit& hit) const;
+
+protected:
+	struct Node
+	{
+		glm::vec3 min;
+		unsigned int first = 0; // If count > 0, the node is a leaf and this is a range in m_triangles. If not, the index of the left child (the right one follows)
+		glm::vec3 max;
+		unsigned int count = 0;
+	};
+	using Nodes = std::vector<Node>;
+
+	void buildNode(Nodes& nodes, unsigned int nodeId, unsigned int first, unsigned int count, int depth);
+	unsigned int split(unsigned int first, unsigned int count, const Node& node, const glm::vec3& centersMin, const glm::vec3& centersMax); // Returns the number of triangles on the left, 0 to create a leaf
+	void append(Nodes& nodes, unsigned int nodeId, const Nodes& subtree); // A subtree built by another thread
+	void updateLeaf(Node& node, const Positions& vertices);
+
+	Nodes m_nodes; // Root first, children are always after their parent
+	Triangles m_triangles; // Sorted by leaf
+	std::vector<unsigned int> m_trianglesIds; // Index given to build of each triangle of m_triangles
+	std::vector<unsigned int> m_leaves;
+
+	BVH::BoundingBoxes m_boxes; // Of the triangles, by their index given to build (only during the build)
+	std::vector<glm::vec3> m_centers;
+};
+
+//****************************************************************************//
+
+inline bool TriangleBVH::empty() const
+{ return m_nodes.empty(); }
+
+} // namespace simplerender
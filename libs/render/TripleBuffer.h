@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+namespace simplerender
+{
+
+// Lock-free exchange of frames between one producer thread and one consumer thread.
+// The producer fills back() then calls publish(), the consumer calls update() and reads front().
+// Neither side ever waits: the producer can publish many frames while the consumer only ever sees the newest complete one.
+template <class T>
+class TripleBuffer
+{
+public:
+	// Producer side
+	T& back();
+	void publish();
+
+	// Consumer side
+	bool update(); // Returns true if a new frame has been published since the last call
+	T& front();
+	const T& front() const;
+
+protected:
+	static const int indexMask = 0x3;
+	static const int newFrameBit = 0x4; // Set in m_middle when the middle buffer has not been taken yet
+
+	std::array<T, 3> m_buffers;
+	int m_front = 0, m_back = 1; // Each one is only accessed by one side
+	std::atomic<int> m_middle = { 2 };
+};
+
+//****************************************************************************//
+
+template <class T>
+inline T& TripleBuffer<T>::back()
+{ return m_buffers[m_back]; }
+
+template <class T>
+inline void TripleBuffer<T>::publish()
+{
+	// Put the back buffer in the middle, and get the previous middle buffer to write the next frame
+	m_back = m_middle.exchange(m_back | newFrameBit, std::memory_order_acq_rel) & indexMask;
+}
+
+template <class T>
+inline bool TripleBuffer<T>::update()
+{
+	if (!(m_middle.load(std::memory_order_relaxed) & newFrameBit))
+		return false;
+
+	// Give the front buffer to the producer, and take the newest frame
+	m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & indexMask;
+	return true;
+}
+
+template <class T>
+inline T& TripleBuffer<T>::front()
+{ return m_buffers[m_front]; }
+
+template <class T>
+inline const T& TripleBuffer<T>::front() const
+{ return m_buffers[m_front]; }
+
+} // namespace simplerender
@@ -0,0 +1,426 @@
+#include <render/VertexKernels.h>
+
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMPLERENDER_SSE2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SIMPLERENDER_TARGET_AVX2
+#else
+#define SIMPLERENDER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+
+using simplerender::InstructionSet;
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "The kernels read the vertices as a packed array of floats");
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "The kernels read the matrices as 4 packed columns");
+
+using BoundingBox = std::pair<glm::vec3, glm::vec3>;
+
+const float floatMax = std::numeric_limits<float>::max();
+
+/******************************************************************************/
+// Scalar versions, also used for the last vertices of the SIMD versions
+
+void accumulateBounds(const glm::vec3* vertices, std::size_t count, glm::vec3& vMin, glm::vec3& vMax)
+{
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		vMin = glm::min(vMin, vertices[i]);
+		vMax = glm::max(vMax, vertices[i]);
+	}
+}
+
+BoundingBox boundsScalar(const glm::vec3* vertices, std::size_t count)
+{
+	glm::vec3 vMin(floatMax), vMax(-floatMax);
+	accumulateBounds(vertices, count, vMin, vMax);
+	return std::make_pair(vMin, vMax);
+}
+
+void transformScalar(const glm::mat4& transformation, const glm::vec3* input, glm::vec3* output, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+		output[i] = glm::vec3(transformation * glm::vec4(input[i], 1));
+}
+
+void normalizeScalar(glm::vec3* vectors, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const float length2 = glm::dot(vectors[i], vectors[i]);
+		if (length2 > 0)
+			vectors[i] *= 1.f / std::sqrt(length2);
+	}
+}
+
+void multiplyScalar(const glm::mat4& lhs, const glm::mat4* input, glm::mat4* output, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+		output[i] = lhs * input[i];
+}
+
+// The lanes of the accumulators contain the components in the order x y z x y z...
+void reduceLanes(const float* mins, const float* maxs, int nbLanes, glm::vec3& vMin, glm::vec3& vMax)
+{
+	for (int i = 0; i < nbLanes; ++i)
+	{
+		vMin[i % 3] = std::min(vMin[i % 3], mins[i]);
+		vMax[i % 3] = std::max(vMax[i % 3], maxs[i]);
+	}
+}
+
+#ifdef SIMPLERENDER_SSE2
+
+/******************************************************************************/
+// SSE2 versions, working on blocks of 4 vertices (3 registers)
+
+// a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+inline void deinterleave(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+{
+	const __m128 t0 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)); // x2 y2 x3 y3
+	const __m128 t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1)); // y0 z0 y1 z1
+	x = _mm_shuffle_ps(a, t0, _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(t1, t0, _MM_SHUFFLE(3, 1, 2, 0));
+	z = _mm_shuffle_ps(t1, c, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+inline void interleave(__m128 x, __m128 y, __m128 z, __m128& a, __m128& b, __m128& c)
+{
+	a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 0, 1, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+	c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+BoundingBox boundsSSE2(const glm::vec3* vertices, std::size_t count)
+{
+	glm::vec3 vMin(floatMax), vMax(-floatMax);
+	const std::size_t nbBlocks = count / 4;
+	if (nbBlocks)
+	{
+		const float* data = reinterpret_cast<const float*>(vertices);
+		__m128 min0 = _mm_set1_ps(floatMax), min1 = min0, min2 = min0;
+		__m128 max0 = _mm_set1_ps(-floatMax), max1 = max0, max2 = max0;
+		for (std::size_t i = 0; i < nbBlocks; ++i, data += 12)
+		{
+			const __m128 a = _mm_loadu_ps(data), b = _mm_loadu_ps(data + 4), c = _mm_loadu_ps(data + 8);
+			min0 = _mm_min_ps(min0, a); max0 = _mm_max_ps(max0, a);
+			min1 = _mm_min_ps(min1, b); max1 = _mm_max_ps(max1, b);
+			min2 = _mm_min_ps(min2, c); max2 = _mm_max_ps(max2, c);
+		}
+
+		float mins[12], maxs[12];
+		_mm_storeu_ps(mins, min0); _mm_storeu_ps(mins + 4, min1); _mm_storeu_ps(mins + 8, min2);
+		_mm_storeu_ps(maxs, max0); _mm_storeu_ps(maxs + 4, max1); _mm_storeu_ps(maxs + 8, max2);
+		reduceLanes(mins, maxs, 12, vMin, vMax);
+	}
+
+	accumulateBounds(vertices + nbBlocks * 4, count - nbBlocks * 4, vMin, vMax);
+	return std::make_pair(vMin, vMax);
+}
+
+void transformSSE2(const glm::mat4& transformation, const glm::vec3* input, glm::vec3* output, std::size_t count)
+{
+	__m128 m[4][3]; // Column, row
+	for (int col = 0; col < 4; ++col)
+	{
+		for (int row = 0; row < 3; ++row)
+			m[col][row] = _mm_set1_ps(transformation[col][row]);
+	}
+
+	const std::size_t nbBlocks = count / 4;
+	const float* src = reinterpret_cast<const float*>(input);
+	float* dst = reinterpret_cast<float*>(output);
+	for (std::size_t i = 0; i < nbBlocks; ++i, src += 12, dst += 12)
+	{
+		__m128 x, y, z;
+		deinterleave(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), x, y, z);
+
+		__m128 r[3];
+		for (int row = 0; row < 3; ++row)
+			r[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][row], x), _mm_mul_ps(m[1][row], y)), _mm_add_ps(_mm_mul_ps(m[2][row], z), m[3][row]));
+
+		__m128 a, b, c;
+		interleave(r[0], r[1], r[2], a, b, c);
+		_mm_storeu_ps(dst, a); _mm_storeu_ps(dst + 4, b); _mm_storeu_ps(dst + 8, c);
+	}
+
+	transformScalar(transformation, input + nbBlocks * 4, output + nbBlocks * 4, count - nbBlocks * 4);
+}
+
+void normalizeSSE2(glm::vec3* vectors, std::size_t count)
+{
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+	const std::size_t nbBlocks = count / 4;
+	float* data = reinterpret_cast<float*>(vectors);
+	for (std::size_t i = 0; i < nbBlocks; ++i, data += 12)
+	{
+		__m128 x, y, z;
+		deinterleave(_mm_loadu_ps(data), _mm_loadu_ps(data + 4), _mm_loadu_ps(data + 8), x, y, z);
+
+		const __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		const __m128 mask = _mm_cmpgt_ps(length2, zero);
+		__m128 scale = _mm_div_ps(one, _mm_sqrt_ps(length2));
+		scale = _mm_or_ps(_mm_and_ps(mask, scale), _mm_andnot_ps(mask, one));
+
+		__m128 a, b, c;
+		interleave(_mm_mul_ps(x, scale), _mm_mul_ps(y, scale), _mm_mul_ps(z, scale), a, b, c);
+		_mm_storeu_ps(data, a); _mm_storeu_ps(data + 4, b); _mm_storeu_ps(data + 8, c);
+	}
+
+	normalizeScalar(vectors + nbBlocks * 4, count - nbBlocks * 4);
+}
+
+// Each column of the result is a combination of the columns of lhs
+void multiplySSE2(const glm::mat4& lhs, const glm::mat4* input, glm::mat4* output, std::size_t count)
+{
+	const float* l = reinterpret_cast<const float*>(&lhs);
+	const __m128 l0 = _mm_loadu_ps(l), l1 = _mm_loadu_ps(l + 4), l2 = _mm_loadu_ps(l + 8), l3 = _mm_loadu_ps(l + 12);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const float* src = reinterpret_cast<const float*>(input + i);
+		__m128 r[4];
+		for (int col = 0; col < 4; ++col)
+		{
+			const __m128 c = _mm_loadu_ps(src + col * 4);
+			r[col] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(l1, _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1)))),
+				_mm_add_ps(_mm_mul_ps(l2, _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 2, 2))), _mm_mul_ps(l3, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3)))));
+		}
+
+		float* dst = reinterpret_cast<float*>(output + i); // Written after all the reads, as input can be output
+		for (int col = 0; col < 4; ++col)
+			_mm_storeu_ps(dst + col * 4, r[col]);
+	}
+}
+
+/******************************************************************************/
+// AVX2 versions, working on blocks of 8 vertices (3 registers)
+
+// Lanes of the 3 registers of a block containing the x, y or z components
+// The register 0 has x in lanes 0 3 6, y in lanes 1 4 7 and z in lanes 2 5, the others are rotated
+const int lanes0 = 0x49, lanes1 = 0x92, lanes2 = 0x24; // Lanes 0 3 6, 1 4 7 and 2 5
+
+SIMPLERENDER_TARGET_AVX2 inline void deinterleave(__m256 a, __m256 b, __m256 c, __m256& x, __m256& y, __m256& z)
+{
+	x = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(a, b, lanes1), c, lanes2), _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+	y = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(a, b, lanes2), c, lanes0), _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+	z = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(a, b, lanes0), c, lanes1), _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+}
+
+SIMPLERENDER_TARGET_AVX2 inline void interleave(__m256 x, __m256 y, __m256 z, __m256& a, __m256& b, __m256& c)
+{
+	const __m256 tx = _mm256_permutevar8x32_ps(x, _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+	const __m256 ty = _mm256_permutevar8x32_ps(y, _mm256_setr_epi32(5, 0, 3, 6, 1, 4, 7, 2));
+	const __m256 tz = _mm256_permutevar8x32_ps(z, _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+	a = _mm256_blend_ps(_mm256_blend_ps(tx, ty, lanes1), tz, lanes2);
+	b = _mm256_blend_ps(_mm256_blend_ps(tx, ty, lanes2), tz, lanes0);
+	c = _mm256_blend_ps(_mm256_blend_ps(tx, ty, lanes0), tz, lanes1);
+}
+
+SIMPLERENDER_TARGET_AVX2 BoundingBox boundsAVX2(const glm::vec3* vertices, std::size_t count)
+{
+	glm::vec3 vMin(floatMax), vMax(-floatMax);
+	const std::size_t nbBlocks = count / 8;
+	if (nbBlocks)
+	{
+		const float* data = reinterpret_cast<const float*>(vertices);
+		__m256 min0 = _mm256_set1_ps(floatMax), min1 = min0, min2 = min0;
+		__m256 max0 = _mm256_set1_ps(-floatMax), max1 = max0, max2 = max0;
+		for (std::size_t i = 0; i < nbBlocks; ++i, data += 24)
+		{
+			const __m256 a = _mm256_loadu_ps(data), b = _mm256_loadu_ps(data + 8), c = _mm256_loadu_ps(data + 16);
+			min0 = _mm256_min_ps(min0, a); max0 = _mm256_max_ps(max0, a);
+			min1 = _mm256_min_ps(min1, b); max1 = _mm256_max_ps(max1, b);
+			min2 = _mm256_min_ps(min2, c); max2 = _mm256_max_ps(max2, c);
+		}
+
+		float mins[24], maxs[24];
+		_mm256_storeu_ps(mins, min0); _mm256_storeu_ps(mins + 8, min1); _mm256_storeu_ps(mins + 16, min2);
+		_mm256_storeu_ps(maxs, max0); _mm256_storeu_ps(maxs + 8, max1); _mm256_storeu_ps(maxs + 16, max2);
+		reduceLanes(mins, maxs, 24, vMin, vMax);
+	}
+
+	accumulateBounds(vertices + nbBlocks * 8, count - nbBlocks * 8, vMin, vMax);
+	return std::make_pair(vMin, vMax);
+}
+
+SIMPLERENDER_TARGET_AVX2 void transformAVX2(const glm::mat4& transformation, const glm::vec3* input, glm::vec3* output, std::size_t count)
+{
+	__m256 m[4][3]; // Column, row
+	for (int col = 0; col < 4; ++col)
+	{
+		for (int row = 0; row < 3; ++row)
+			m[col][row] = _mm256_set1_ps(transformation[col][row]);
+	}
+
+	const std::size_t nbBlocks = count / 8;
+	const float* src = reinterpret_cast<const float*>(input);
+	float* dst = reinterpret_cast<float*>(output);
+	for (std::size_t i = 0; i < nbBlocks; ++i, src += 24, dst += 24)
+	{
+		__m256 x, y, z;
+		deinterleave(_mm256_loadu_ps(src), _mm256_loadu_ps(src + 8), _mm256_loadu_ps(src + 16), x, y, z);
+
+		__m256 r[3];
+		for (int row = 0; row < 3; ++row)
+			r[row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0][row], x), _mm256_mul_ps(m[1][row], y)), _mm256_add_ps(_mm256_mul_ps(m[2][row], z), m[3][row]));
+
+		__m256 a, b, c;
+		interleave(r[0], r[1], r[2], a, b, c);
+		_mm256_storeu_ps(dst, a); _mm256_storeu_ps(dst + 8, b); _mm256_storeu_ps(dst + 16, c);
+	}
+
+	transformSSE2(transformation, input + nbBlocks * 8, output + nbBlocks * 8, count - nbBlocks * 8);
+}
+
+// Two columns of the result per register
+SIMPLERENDER_TARGET_AVX2 void multiplyAVX2(const glm::mat4& lhs, const glm::mat4* input, glm::mat4* output, std::size_t count)
+{
+	__m256 l[4]; // Each column of lhs, in both halves
+	for (int k = 0; k < 4; ++k)
+	{
+		const __m128 column = _mm_loadu_ps(reinterpret_cast<const float*>(&lhs) + k * 4);
+		l[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(column), column, 1);
+	}
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const float* src = reinterpret_cast<const float*>(input + i);
+		const __m256 c01 = _mm256_loadu_ps(src), c23 = _mm256_loadu_ps(src + 8);
+		const __m256 r01 = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(l[0], _mm256_shuffle_ps(c01, c01, _MM_SHUFFLE(0, 0, 0, 0))), _mm256_mul_ps(l[1], _mm256_shuffle_ps(c01, c01, _MM_SHUFFLE(1, 1, 1, 1)))),
+			_mm256_add_ps(_mm256_mul_ps(l[2], _mm256_shuffle_ps(c01, c01, _MM_SHUFFLE(2, 2, 2, 2))), _mm256_mul_ps(l[3], _mm256_shuffle_ps(c01, c01, _MM_SHUFFLE(3, 3, 3, 3)))));
+		const __m256 r23 = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(l[0], _mm256_shuffle_ps(c23, c23, _MM_SHUFFLE(0, 0, 0, 0))), _mm256_mul_ps(l[1], _mm256_shuffle_ps(c23, c23, _MM_SHUFFLE(1, 1, 1, 1)))),
+			_mm256_add_ps(_mm256_mul_ps(l[2], _mm256_shuffle_ps(c23, c23, _MM_SHUFFLE(2, 2, 2, 2))), _mm256_mul_ps(l[3], _mm256_shuffle_ps(c23, c23, _MM_SHUFFLE(3, 3, 3, 3)))));
+
+		float* dst = reinterpret_cast<float*>(output + i);
+		_mm256_storeu_ps(dst, r01);
+		_mm256_storeu_ps(dst + 8, r23);
+	}
+}
+
+SIMPLERENDER_TARGET_AVX2 void normalizeAVX2(glm::vec3* vectors, std::size_t count)
+{
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+	const std::size_t nbBlocks = count / 8;
+	float* data = reinterpret_cast<float*>(vectors);
+	for (std::size_t i = 0; i < nbBlocks; ++i, data += 24)
+	{
+		__m256 x, y, z;
+		deinterleave(_mm256_loadu_ps(data), _mm256_loadu_ps(data + 8), _mm256_loadu_ps(data + 16), x, y, z);
+
+		const __m256 length2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+		const __m256 mask = _mm256_cmp_ps(length2, zero, _CMP_GT_OQ);
+		const __m256 scale = _mm256_blendv_ps(one, _mm256_div_ps(one, _mm256_sqrt_ps(length2)), mask);
+
+		__m256 a, b, c;
+		interleave(_mm256_mul_ps(x, scale), _mm256_mul_ps(y, scale), _mm256_mul_ps(z, scale), a, b, c);
+		_mm256_storeu_ps(data, a); _mm256_storeu_ps(data + 8, b); _mm256_storeu_ps(data + 16, c);
+	}
+
+	normalizeSSE2(vectors + nbBlocks * 8, count - nbBlocks * 8);
+}
+
+bool cpuHasAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// The OS must also save the AVX registers
+	__cpuid(info, 1);
+	const int osxsave = 1 << 27, avx = 1 << 28;
+	if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // SIMPLERENDER_SSE2
+
+/******************************************************************************/
+
+struct Kernels
+{
+	InstructionSet instructionSet = InstructionSet::Scalar;
+	BoundingBox (*bounds)(const glm::vec3*, std::size_t) = &boundsScalar;
+	void (*transform)(const glm::mat4&, const glm::vec3*, glm::vec3*, std::size_t) = &transformScalar;
+	void (*normalize)(glm::vec3*, std::size_t) = &normalizeScalar;
+	void (*multiply)(const glm::mat4&, const glm::mat4*, glm::mat4*, std::size_t) = &multiplyScalar;
+};
+
+Kernels selectKernels()
+{
+	Kernels kernels;
+#ifdef SIMPLERENDER_SSE2
+	if (cpuHasAVX2())
+	{
+		kernels.instructionSet = InstructionSet::AVX2;
+		kernels.bounds = &boundsAVX2;
+		kernels.transform = &transformAVX2;
+		kernels.normalize = &normalizeAVX2;
+		kernels.multiply = &multiplyAVX2;
+	}
+	else
+	{
+		kernels.instructionSet = InstructionSet::SSE2;
+		kernels.bounds = &boundsSSE2;
+		kernels.transform = &transformSSE2;
+		kernels.normalize = &normalizeSSE2;
+		kernels.multiply = &multiplySSE2;
+	}
+#endif
+	return kernels;
+}
+
+const Kernels& kernels()
+{
+	static const Kernels selected = selectKernels();
+	return selected;
+}
+
+}
+
+namespace simplerender
+{
+
+InstructionSet simdInstructionSet()
+{
+	return kernels().instructionSet;
+}
+
+std::pair<glm::vec3, glm::vec3> computeBounds(const glm::vec3* vertices, std::size_t count)
+{
+	return kernels().bounds(vertices, count);
+}
+
+void transformPositions(const glm::mat4& transformation, const glm::vec3* input, glm::vec3* output, std::size_t count)
+{
+	kernels().transform(transformation, input, output, count);
+}
+
+void normalizeVectors(glm::vec3* vectors, std::size_t count)
+{
+	kernels().normalize(vectors, count);
+}
+
+void multiplyMatrices(const glm::mat4& lhs, const glm::mat4* input, glm::mat4* output, std::size_t count)
+{
+	kernels().multiply(lhs, input, output, count);
+}
+
+} // namespace simplerender
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <utility>
+
+namespace simplerender
+{
+
+// Bulk operations on arrays of glm::vec3 and glm::mat4, using SSE2 or AVX2 when available
+enum class InstructionSet { Scalar, SSE2, AVX2 };
+
+InstructionSet simdInstructionSet(); // The one used by the kernels, detected at the first call
+
+std::pair<glm::vec3, glm::vec3> computeBounds(const glm::vec3* vertices, std::size_t count); // Returns min > max if count is 0
+void transformPositions(const glm::mat4& transformation, const glm::vec3* input, glm::vec3* output, std::size_t count); // input and output can be the same array
+void normalizeVectors(glm::vec3* vectors, std::size_t count); // Vectors of length 0 are not modified
+void multiplyMatrices(const glm::mat4& lhs, const glm::mat4* input, glm::mat4* output, std::size_t count); // output[i] = lhs * input[i], input and output can be the same array
+
+} // namespace simplerender
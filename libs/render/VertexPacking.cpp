@@ -0,0 +1,195 @@
+#include <render/VertexPacking.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+const float halfTexCoordsMax = 4.f; // Above that, half floats have less than 9 bits of precision after the decimal point
+
+// Signed normalized 10 bits value, in two's complement
+inline std::uint32_t packSnorm10(float value)
+{
+	const auto scaled = static_cast<int>(std::round(std::max(-1.f, std::min(1.f, value)) * 511.f));
+	return static_cast<std::uint32_t>(scaled) & 0x3ff;
+}
+
+inline std::uint16_t packUnorm16(float value)
+{
+	return static_cast<std::uint16_t>(std::round(value * 65535.f));
+}
+
+}
+
+namespace simplerender
+{
+
+std::uint32_t packNormal(const glm::vec3& normal)
+{
+	return packSnorm10(normal.x) | (packSnorm10(normal.y) << 10) | (packSnorm10(normal.z) << 20);
+}
+
+void packNormals(const glm::vec3* normals, std::size_t count, std::uint32_t* output)
+{
+	for (std::size_t i = 0; i < count; ++i)
+		output[i] = packNormal(normals[i]);
+}
+
+std::uint16_t packHalf(float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	const std::uint32_t sign = (bits >> 16) & 0x8000;
+	const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+	std::uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent >= 31) // Too big (or NaN), clamped to infinity
+		return static_cast<std::uint16_t>(sign | 0x7c00);
+
+	if (exponent <= 0) // Denormalized half, or zero
+	{
+		if (exponent < -10)
+			return static_cast<std::uint16_t>(sign);
+
+		mantissa |= 0x800000; // Implicit leading bit
+		const int shift = 14 - exponent;
+		std::uint32_t half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1) // Round to nearest
+			++half;
+		return static_cast<std::uint16_t>(sign | half);
+	}
+
+	std::uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000) // Round to nearest, a carry correctly increments the exponent
+		++half;
+	return static_cast<std::uint16_t>(half);
+}
+
+TexCoordsPacking selectTexCoordsPacking(const std::vector<glm::vec2>& texCoords)
+{
+	if (texCoords.empty())
+		return TexCoordsPacking::Float;
+
+	glm::vec2 tMin = texCoords.front(), tMax = texCoords.front();
+	for (const auto& texCoord : texCoords)
+	{
+		tMin = glm::min(tMin, texCoord);
+		tMax = glm::max(tMax, texCoord);
+	}
+
+	if (tMin.x >= 0 && tMin.y >= 0 && tMax.x <= 1 && tMax.y <= 1)
+		return TexCoordsPacking::Unorm16;
+
+	if (tMin.x >= -halfTexCoordsMax && tMin.y >= -halfTexCoordsMax && tMax.x <= halfTexCoordsMax && tMax.y <= halfTexCoordsMax)
+		return TexCoordsPacking::Half;
+
+	return TexCoordsPacking::Float;
+}
+
+std::vector<std::uint16_t> packTexCoords(const std::vector<glm::vec2>& texCoords, TexCoordsPacking packing)
+{
+	std::vector<std::uint16_t> packed;
+	if (packing == TexCoordsPacking::Float)
+		return packed;
+
+	packed.reserve(texCoords.size() * 2);
+	for (const auto& texCoord : texCoords)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			if (packing == TexCoordsPacking::Unorm16)
+				packed.push_back(packUnorm16(texCoord[i]));
+			else
+				packed.push_back(packHalf(texCoord[i]));
+		}
+	}
+
+	return packed;
+}
+
+std::size_t texCoordSize(TexCoordsPacking packing)
+{
+	return (packing == TexCoordsPacking::Float) ? 2 * sizeof(float) : 2 * sizeof(std::uint16_t);
+}
+
+InterleavedLayout interleavedLayout(bool positions, bool normals, bool packedNormals, bool texCoords, TexCoordsPacking texCoordsPacking)
+{
+	// Every attribute size is a multiple of 4 bytes, so they stay aligned
+	InterleavedLayout layout;
+	layout.hasPositions = positions;
+	layout.hasNormals = normals;
+	layout.hasTexCoords = texCoords;
+	layout.packedNormals = packedNormals;
+	layout.texCoordsPacking = texCoordsPacking;
+
+	if (positions)
+	{
+		layout.positionsOffset = layout.stride;
+		layout.stride += 3 * sizeof(float);
+	}
+
+	if (normals)
+	{
+		layout.normalsOffset = layout.stride;
+		layout.stride += packedNormals ? sizeof(std::uint32_t) : 3 * sizeof(float);
+	}
+
+	if (texCoords)
+	{
+		layout.texCoordsOffset = layout.stride;
+		layout.stride += texCoordSize(texCoordsPacking);
+	}
+
+	return layout;
+}
+
+void interleave(const InterleavedLayout& layout, const glm::vec3* positions, const glm::vec3* normals, const glm::vec2* texCoords,
+				std::size_t first, std::size_t count, unsigned char* output)
+{
+	for (std::size_t i = first, end = first + count; i < end; ++i)
+	{
+		if (layout.hasPositions)
+			std::memcpy(output + layout.positionsOffset, &positions[i], 3 * sizeof(float));
+
+		if (layout.hasNormals)
+		{
+			if (layout.packedNormals)
+			{
+				const auto packed = packNormal(normals[i]);
+				std::memcpy(output + layout.normalsOffset, &packed, sizeof(packed));
+			}
+			else
+				std::memcpy(output + layout.normalsOffset, &normals[i], 3 * sizeof(float));
+		}
+
+		if (layout.hasTexCoords)
+		{
+			const auto& texCoord = texCoords[i];
+			std::uint16_t packed[2];
+			switch (layout.texCoordsPacking)
+			{
+			case TexCoordsPacking::Float:
+				std::memcpy(output + layout.texCoordsOffset, &texCoord, 2 * sizeof(float));
+				break;
+
+			case TexCoordsPacking::Unorm16:
+				packed[0] = packUnorm16(texCoord.x);
+				packed[1] = packUnorm16(texCoord.y);
+				std::memcpy(output + layout.texCoordsOffset, packed, sizeof(packed));
+				break;
+
+			case TexCoordsPacking::Half:
+				packed[0] = packHalf(texCoord.x);
+				packed[1] = packHalf(texCoord.y);
+				std::memcpy(output + layout.texCoordsOffset, packed, sizeof(packed));
+				break;
+			}
+		}
+
+		output += layout.stride;
+	}
+}
+
+} // namespace simplerender
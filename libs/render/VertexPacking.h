@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace simplerender
+{
+
+// Conversions of the vertex attributes to the compact formats used on the GPU
+
+// Normals as GL_INT_2_10_10_10_REV (normalized), each component must be in [-1, 1]
+std::uint32_t packNormal(const glm::vec3& normal);
+void packNormals(const glm::vec3* normals, std::size_t count, std::uint32_t* output);
+
+std::uint16_t packHalf(float value); // IEEE 754 half precision float (GL_HALF_FLOAT)
+
+enum class TexCoordsPacking
+{
+	Float,		// 2 floats
+	Unorm16,	// 2 GL_UNSIGNED_SHORT (normalized), if every coordinate is in [0, 1]
+	Half		// 2 GL_HALF_FLOAT, if the coordinates are small enough to keep a good precision
+};
+
+TexCoordsPacking selectTexCoordsPacking(const std::vector<glm::vec2>& texCoords);
+std::vector<std::uint16_t> packTexCoords(const std::vector<glm::vec2>& texCoords, TexCoordsPacking packing); // Empty for TexCoordsPacking::Float
+std::size_t texCoordSize(TexCoordsPacking packing); // In bytes, for one vertex
+
+// Position of each attribute inside an interleaved vertex, in bytes
+struct InterleavedLayout
+{
+	bool hasPositions = false, hasNormals = false, hasTexCoords = false;
+	bool packedNormals = false;
+	TexCoordsPacking texCoordsPacking = TexCoordsPacking::Float;
+	std::size_t positionsOffset = 0, normalsOffset = 0, texCoordsOffset = 0;
+	std::size_t stride = 0; // 0 if there is no attribute
+};
+
+InterleavedLayout interleavedLayout(bool positions, bool normals, bool packedNormals, bool texCoords, TexCoordsPacking texCoordsPacking);
+
+// Writes the vertices [first, first + count[ in output (which must contain count * stride bytes)
+// The arrays of the attributes not in the layout can be null
+void interleave(const InterleavedLayout& layout, const glm::vec3* positions, const glm::vec3* normals, const glm::vec2* texCoords,
+				std::size_t first, std::size_t count, unsigned char* output);
+
+} // namespace simplerender
@@ -0,0 +1,120 @@
+// Times the ray casts of the picking against a dense mesh, and the refit done after each simulation step
+// Usage: PickingBenchmark [number of quads per side] (708 by default, so about a million triangles)
+// Returns 1 if the 99th percentile of the picks is above the target (the worst one can be a preemption of the thread)
+
+#include <render/TriangleBVH.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+using simplerender::TriangleBVH;
+
+const double targetPickTime = 1.0; // Milliseconds
+const int nbPicks = 10000;
+const int nbRefits = 10;
+
+using Clock = std::chrono::high_resolution_clock;
+
+double elapsed(Clock::time_point start)
+{
+	const std::chrono::duration<double, std::milli> duration = Clock::now() - start;
+	return duration.count();
+}
+
+// A wavy grid in the XY plane, like a deformable surface of a simulation
+void createGrid(int size, float phase, TriangleBVH::Positions& vertices, TriangleBVH::Triangles& triangles)
+{
+	const int nbSide = size + 1;
+	vertices.resize(nbSide * nbSide);
+	for (int y = 0; y < nbSide; ++y)
+	{
+		for (int x = 0; x < nbSide; ++x)
+		{
+			const float fx = static_cast<float>(x) / size, fy = static_cast<float>(y) / size;
+			vertices[y * nbSide + x] = glm::vec3(fx, fy, 0.05f * std::sin(20.f * fx + phase) * std::cos(20.f * fy));
+		}
+	}
+
+	if (!triangles.empty())
+		return;
+
+	triangles.reserve(2 * size * size);
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			const unsigned int i = y * nbSide + x;
+			triangles.push_back({ { i, i + 1, i + nbSide + 1 } });
+			triangles.push_back({ { i, i + nbSide + 1, i + nbSide } });
+		}
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int size = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 708;
+
+	TriangleBVH::Positions vertices;
+	TriangleBVH::Triangles triangles;
+	createGrid(size, 0.f, vertices, triangles);
+	std::cout << triangles.size() << " triangles" << std::endl;
+
+	TriangleBVH bvh;
+	auto start = Clock::now();
+	bvh.build(vertices, triangles);
+	std::cout << "Build: " << elapsed(start) << " ms" << std::endl;
+
+	// Vertices moved by a step, then the hierarchy is refitted (done by Mesh::updatePositions)
+	double refitTime = 0;
+	for (int i = 1; i <= nbRefits; ++i)
+	{
+		createGrid(size, 0.1f * i, vertices, triangles);
+		start = Clock::now();
+		bvh.refit(vertices);
+		refitTime += elapsed(start);
+	}
+	std::cout << "Refit: " << refitTime / nbRefits << " ms" << std::endl;
+
+	// Rays from a camera above the grid, towards random points of it
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> distribution(0.f, 1.f);
+	const glm::vec3 eye(0.5f, -0.5f, 1.5f);
+	std::vector<double> times;
+	times.reserve(nbPicks);
+	int nbHits = 0;
+	for (int i = 0; i < nbPicks; ++i)
+	{
+		const glm::vec3 target(distribution(generator), distribution(generator), 0.f);
+		const simplerender::Ray ray(eye, target - eye);
+		TriangleBVH::Hit hit;
+		start = Clock::now();
+		if (bvh.intersect(vertices, ray, 10.f, hit))
+			++nbHits;
+		times.push_back(elapsed(start));
+	}
+
+	std::sort(times.begin(), times.end());
+	double totalTime = 0;
+	for (auto time : times)
+		totalTime += time;
+	const auto percentileTime = times[nbPicks * 99 / 100];
+	std::cout << "Pick: " << totalTime / nbPicks << " ms on average, " << percentileTime << " ms at the 99th percentile, "
+		<< times.back() << " ms at worst (" << nbHits << " hits on " << nbPicks << " rays)" << std::endl;
+
+	if (percentileTime > targetPickTime)
+	{
+		std::cout << "The picks take more than the target of " << targetPickTime << " ms" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,131 @@
+// Compares the kernels of VertexKernels.h to the scalar loops they replaced
+// Usage: VertexKernelsBenchmark [number of vertices] (2 millions by default)
+
+#include <render/VertexKernels.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+using Vertices = std::vector<glm::vec3>;
+using BoundingBox = std::pair<glm::vec3, glm::vec3>;
+
+const int nbRuns = 10; // The fastest run is kept
+
+// The loops of Mesh.cpp and NormalsComputation.cpp before the kernels
+BoundingBox boundsReference(const Vertices& vertices)
+{
+	glm::vec3 vMin, vMax;
+	for (int i = 0; i < 3; ++i)
+	{
+		vMin[i] = std::numeric_limits<float>::max();
+		vMax[i] = -std::numeric_limits<float>::max();
+	}
+
+	for (const auto& vertex : vertices)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			vMin[i] = std::min(vMin[i], vertex[i]);
+			vMax[i] = std::max(vMax[i], vertex[i]);
+		}
+	}
+
+	return std::make_pair(vMin, vMax);
+}
+
+void transformReference(const glm::mat4& transformation, const Vertices& input, Vertices& output)
+{
+	for (std::size_t i = 0, nb = input.size(); i < nb; ++i)
+		output[i] = glm::vec3(transformation * glm::vec4(input[i], 1));
+}
+
+void normalizeReference(Vertices& vectors)
+{
+	for (auto& v : vectors)
+		v = glm::normalize(v);
+}
+
+double bestTime(const std::function<void()>& func)
+{
+	double best = std::numeric_limits<double>::max();
+	for (int i = 0; i < nbRuns; ++i)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		func();
+		const std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+		best = std::min(best, duration.count());
+	}
+	return best;
+}
+
+float maxDifference(const Vertices& lhs, const Vertices& rhs)
+{
+	float diff = 0;
+	for (std::size_t i = 0, nb = lhs.size(); i < nb; ++i)
+		diff = std::max(diff, glm::length(lhs[i] - rhs[i]));
+	return diff;
+}
+
+void report(const char* name, double reference, double kernel, float difference)
+{
+	std::cout << name << ": " << reference << " ms -> " << kernel << " ms (x" << reference / kernel << "), max difference " << difference << std::endl;
+}
+
+const char* instructionSetName(simplerender::InstructionSet set)
+{
+	switch (set)
+	{
+	case simplerender::InstructionSet::AVX2: return "AVX2";
+	case simplerender::InstructionSet::SSE2: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const std::size_t nbVertices = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+	std::cout << nbVertices << " vertices, kernels using " << instructionSetName(simplerender::simdInstructionSet()) << std::endl;
+
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> distribution(-100.f, 100.f);
+	Vertices vertices(nbVertices);
+	for (auto& v : vertices)
+		v = glm::vec3(distribution(generator), distribution(generator), distribution(generator));
+
+	// Bounding box
+	BoundingBox reference, kernel;
+	const auto boundsRefTime = bestTime([&]() { reference = boundsReference(vertices); });
+	const auto boundsTime = bestTime([&]() { kernel = simplerender::computeBounds(vertices.data(), vertices.size()); });
+	report("Bounds", boundsRefTime, boundsTime, std::max(glm::length(reference.first - kernel.first), glm::length(reference.second - kernel.second)));
+
+	// Affine transformation
+	glm::mat4 transformation(1.f);
+	transformation[0] = glm::vec4(0.8f, 0.6f, 0.f, 0.f);
+	transformation[1] = glm::vec4(-0.6f, 0.8f, 0.f, 0.f);
+	transformation[2] = glm::vec4(0.f, 0.f, 2.f, 0.f);
+	transformation[3] = glm::vec4(10.f, -5.f, 3.f, 1.f);
+	Vertices transformedRef(nbVertices), transformed(nbVertices);
+	const auto transformRefTime = bestTime([&]() { transformReference(transformation, vertices, transformedRef); });
+	const auto transformTime = bestTime([&]() { simplerender::transformPositions(transformation, vertices.data(), transformed.data(), vertices.size()); });
+	report("Transform", transformRefTime, transformTime, maxDifference(transformedRef, transformed));
+
+	// Normalization (on copies, as it is done in place)
+	Vertices normalizedRef, normalized;
+	const auto normalizeRefTime = bestTime([&]() { normalizedRef = vertices; normalizeReference(normalizedRef); });
+	const auto normalizeTime = bestTime([&]() { normalized = vertices; simplerender::normalizeVectors(normalized.data(), normalized.size()); });
+	report("Normalize (with copy)", normalizeRefTime, normalizeTime, maxDifference(normalizedRef, normalized));
+
+	return 0;
+}
@@ -1,141 +1,120 @@
-const char* trianglesColorFragmentShader = R"~~(#version 330 core
-in vec4 vPosition;
-in vec4 vNormal;
-
-uniform vec4 diffuseColor;
-uniform vec4 ambientColor;
-uniform vec4 specularColor;
-uniform float shininess;
+// Sources of the variants of the mesh program (see ShaderVariants), the #version directive and the defines are inserted before them
+// NORMALS: lighting of the triangles (lines are drawn with the diffuse color)
+// TEXTURE: the diffuse color is read from the texture
+// INSTANCED: the transformation of each instance is an attribute, and the camera is in the Camera uniform block
 
-out vec4 color;
-
-void main()
-{
-	vec3 N = normalize(vNormal.xyz);
-	vec3 L = normalize(vec3(0.0, 0.2, 1.0) - vPosition.xyz);
-	vec3 E = normalize(-vPosition.xyz); // eyePos is (0,0,0)
-	vec3 R = normalize(-reflect(L, N));
-	
-	// Ambient term
-	vec4 ambient = ambientColor;
-	
-	// Diffuse Term
-	vec4 diffuse = diffuseColor;
-//	diffuse = diffuse * max(dot(N,L), 0.0);	// 1 faced
-	diffuse = diffuse * abs(dot(N,L));		// 2 faced
-	diffuse = clamp(diffuse, 0.0, 1.0);
-
-	// Specular Term
-	vec4 specular = specularColor * pow(max(dot(R,E),0.0), shininess);
-	specular = clamp(specular, 0.0, 1.0);
-
-	// Write final color
-	color = ambient + diffuse + specular;
-}
-)~~";
-
-const char* trianglesColorVertexShader = R"~~(#version 330 core
-#extension GL_ARB_explicit_attrib_location : enable
+const char* meshVertexShader = R"~~(#extension GL_ARB_explicit_attrib_location : enable
 layout (location = 0) in vec3 position;
+
+#ifdef NORMALS
 layout (location = 1) in vec3 normal;
 
 out vec4 vPosition;
 out vec4 vNormal;
+#endif
+
+#ifdef TEXTURE
+layout (location = 2) in vec2 texCoord;
+
+out vec2 vTexCoord;
+#endif
+
+#ifdef INSTANCED
+layout (location = 3) in mat4 transformation;
 
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+};
+#else
 uniform mat4 MV;
 uniform mat4 MVP;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+	vec4 worldPosition = transformation * vec4(position, 1.0f);
+	gl_Position = viewProjection * worldPosition;
+#ifdef NORMALS
+	vPosition	= view * worldPosition;
+	vNormal 	= view * (transformation * vec4(normal, 0.0f));
+#endif
+#else
 	gl_Position = MVP * vec4(position, 1.0f);
+#ifdef NORMALS
 	vPosition	= MV * vec4(position, 1.0f);
 	vNormal 	= MV * vec4(normal, 0.0f);
+#endif
+#endif
+
+#ifdef TEXTURE
+	vTexCoord = vec2(texCoord.x, 1.0f - texCoord.y);
+#endif
 }
 )~~";
 
-//****************************************************************************//
-
-const char* trianglesTextureFragmentShader = R"~~(#version 330 core
+const char* meshFragmentShader = R"~~(
+#ifdef NORMALS
 in vec4 vPosition;
 in vec4 vNormal;
+#endif
+
+#ifdef TEXTURE
 in vec2 vTexCoord;
 
 uniform sampler2D tex0;
-uniform vec4 ambientColor;
-uniform vec4 specularColor;
-uniform float shininess;
+#endif
+
+struct Material
+{
+	vec4 diffuse;
+	vec4 ambient;
+	vec4 specular;
+	float shininess;
+};
+
+layout (std140) uniform Materials
+{
+	Material materials[256];
+};
+uniform int materialIndex;
 
 out vec4 color;
 
 void main()
 {
+	Material material = materials[materialIndex];
+
+#ifdef NORMALS
 	vec3 N = normalize(vNormal.xyz);
 	vec3 L = normalize(vec3(0.0, 0.2, 1.0) - vPosition.xyz);
 	vec3 E = normalize(-vPosition.xyz); // eyePos is (0,0,0)
 	vec3 R = normalize(-reflect(L, N));
-	
+
 	// Ambient term
-	vec4 ambient = ambientColor;
-	
+	vec4 ambient = material.ambient;
+
 	// Diffuse Term
+#ifdef TEXTURE
 	vec4 diffuse = texture(tex0, vTexCoord);
+#else
+	vec4 diffuse = material.diffuse;
+#endif
 //	diffuse = diffuse * max(dot(N,L), 0.0);	// 1 faced
 	diffuse = diffuse * abs(dot(N,L));		// 2 faced
 	diffuse = clamp(diffuse, 0.0, 1.0);
 
 	// Specular Term
-	vec4 specular = specularColor * pow(max(dot(R,E),0.0), shininess);
+	vec4 specular = material.specular * pow(max(dot(R,E),0.0), material.shininess);
 	specular = clamp(specular, 0.0, 1.0);
 
 	// Write final color
 	color = ambient + diffuse + specular;
+#else
+	color = material.diffuse;
+#endif
 }
 )~~";
-
-const char* trianglesTextureVertexShader = R"~~(#version 330 core
-#extension GL_ARB_explicit_attrib_location : enable
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in vec2 texCoord;
-
-out vec4 vPosition;
-out vec4 vNormal;
-out vec2 vTexCoord;
-
-uniform mat4 MV;
-uniform mat4 MVP;
-
-void main()
-{
-	gl_Position = MVP * vec4(position, 1.0f);
-	vPosition	= MV * vec4(position, 1.0f);
-	vNormal 	= MV * vec4(normal, 0.0f);
-	
-	vTexCoord = vec2(texCoord.x, 1.0f - texCoord.y);
-}
-)~~";
-
-//****************************************************************************//
-
-const char* linesFragmentShader = R"~~(#version 330 core
-uniform vec4 diffuseColor;
-
-out vec4 color;
-
-void main()
-{
-	color = diffuseColor;
-}
-)~~";
-
-const char* linesVertexShader = R"~~(#version 330 core
-#extension GL_ARB_explicit_attrib_location : enable
-layout (location = 0) in vec3 position;
-
-uniform mat4 MVP;
-
-void main()
-{
-	gl_Position = MVP * vec4(position, 1.0f);
-}
-)~~";
\ No newline at end of file
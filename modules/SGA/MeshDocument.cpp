@@ -10,6 +10,7 @@
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 int registerMeshDocument()
@@ -112,6 +113,22 @@ int indexOf(C& container, const T& val)
 		return std::distance(container.begin(), it);
 }
 
+bool hasTransform(MeshNode::Type type)
+{
+	return type == MeshNode::Type::Root || type == MeshNode::Type::Node || type == MeshNode::Type::Instance;
+}
+
+// Column major, as used by the renderer
+glm::mat4 localTransformation(const TransformationComponents& transformation)
+{
+	glm::quat orientation(glm::radians(transformation.rotation));
+	glm::mat4 transMat;
+	transMat = glm::translate(transMat, transformation.translation);
+	transMat = transMat * glm::toMat4(orientation);
+	transMat = glm::scale(transMat, transformation.scale);
+	return transMat;
+}
+
 }
 
 TransformationComponents toTransformationComponents(const glm::mat4& matrix)
@@ -145,20 +162,15 @@ TransformationComponents toTransformationComponents(const glm::mat4& matrix)
 
 glm::mat4 toTransformationMatrix(const TransformationComponents& transformation)
 {
-	glm::quat orientation(glm::radians(transformation.rotation));
-	glm::mat4 transMat;
-	transMat = glm::translate(transMat, transformation.translation);
-	transMat = transMat * glm::toMat4(orientation);
-	transMat = glm::scale(transMat, transformation.scale);
-	transMat = glm::transpose(transMat);
-
-	return transMat;
+	return glm::transpose(localTransformation(transformation));
 }
 
 MeshDocument::MeshDocument(const std::string& type)
 	: BaseDocument(type)
 	, m_mouseManipulator(m_scene)
 {
+	m_mouseManipulator.setPickCallback([this](const simplerender::PickResult& result) { selectInstance(result); });
+
 	createGraphImages();
 	m_rootNode = createNode("ModelViewer", MeshNode::Type::Root, nullptr);
 	m_meshesGroup = createNode("Meshes", MeshNode::Type::MeshesGroup, m_rootNode.get()).get();
@@ -169,6 +181,7 @@ bool MeshDocument::loadFile(const std::string& path)
 {
 	MeshImport importer(this, m_scene, m_graph);
 	std::tie(m_newMeshes, m_newMaterials) = importer.importMeshes(path);
+	generateLODs(m_newMeshes);
 	return true;
 }
 
@@ -181,11 +194,15 @@ void MeshDocument::initUI(simplegui::SimpleGUI& gui)
 {
 	m_gui = &gui;
 	m_graph.setRoot(m_rootNode);
+	simplerender::ShaderProgram::setBinaryCacheDirectory(gui.cacheDirectory()); // Used by initOpenGL
 
 	auto& toolsMenu = gui.getMenu(simplegui::MenuType::Tools);
 	toolsMenu.addItem("Remove duplicate meshes", "Remove meshes that are identical to each other", [this](){ removeDuplicateMeshes(); });
 	toolsMenu.addItem("Remove unused meshes", "Remove meshes that have no instance", [this](){ removeUnusedMeshes(); });
 	toolsMenu.addItem("Remove unused materials", "Remove materials that have no instance", [this](){ removeUnusedMaterials(); });
+	toolsMenu.addItem("Generate levels of detail", "Create simplified versions of the meshes, drawn for the small instances on screen", [this](){ generateLODs(); });
+
+	m_renderUI.init(gui); // Textures settings and status
 }
 
 void MeshDocument::initOpenGL()
@@ -209,6 +226,7 @@ void MeshDocument::render()
 	m_newMaterials.clear();
 
 	m_scene.render();
+	m_renderUI.update();
 }
 
 bool MeshDocument::mouseEvent(const MouseEvent& event)
@@ -216,6 +234,19 @@ bool MeshDocument::mouseEvent(const MouseEvent& event)
 	return m_mouseManipulator.mouseEvent(event);
 }
 
+void MeshDocument::selectInstance(const simplerender::PickResult& result)
+{
+	if (!m_gui)
+		return;
+
+	auto nodes = convertToMeshNodes(getNodes(m_rootNode.get(), MeshNode::Type::Instance));
+	auto it = std::find_if(nodes.begin(), nodes.end(), [&result](const MeshNode* node) {
+		return node->instance == result.instance;
+	});
+	if (it != nodes.end())
+		m_gui->selectNode(*it);
+}
+
 MeshNode::SPtr MeshDocument::createNode(const std::string& name, MeshNode::Type nodeType, GraphNode* parent, int position)
 {
 	auto node = MeshNode::create();
@@ -227,6 +258,8 @@ MeshNode::SPtr MeshDocument::createNode(const std::string& name, MeshNode::Type
 	node->imageId = m_graphMeshImages[static_cast<int>(nodeType)];
 	if (parent)
 		m_graph.insertChild(parent, node, position);
+	if (hasTransform(nodeType))
+		addTransform(node.get());
 
 	return node;
 }
@@ -245,6 +278,10 @@ GraphNode::SPtr MeshDocument::createNode(const std::string& typeName, const std:
 	if (meshType == MeshNode::Type::Mesh)
 	{
 		auto mesh = std::make_shared<simplerender::Mesh>();
+		mesh->setStorageMode(simplerender::StorageMode::Static);
+		mesh->setAttributesFormat(simplerender::AttributesFormat::Compact);
+		mesh->setVertexLayout(simplerender::VertexLayout::Interleaved);
+		mesh->setBufferArenas(m_scene.bufferArenas());
 		m_scene.addMesh(mesh);
 		node->mesh = mesh;
 		m_newMeshes.push_back(mesh.get());
@@ -307,6 +344,15 @@ MeshDocument::ObjectPropertiesPtr MeshDocument::objectProperties(GraphNode* base
 			properties->createRefProperty("triangles", mesh->m_triangles);
 			properties->createRefProperty("normals", mesh->m_normals);
 			properties->createRefProperty("UV", mesh->m_texCoords);
+
+			auto cacheStatistics = mesh->vertexCacheStatistics();
+			properties->createCopyProperty("ACMR before optimization", cacheStatistics.acmrBefore)->setReadOnly(true);
+			properties->createCopyProperty("ACMR after optimization", cacheStatistics.acmrAfter)->setReadOnly(true);
+
+			const auto& memory = mesh->buffersMemory();
+			int gpuMemory = static_cast<int>(memory.used), savedMemory = static_cast<int>(memory.full - memory.used);
+			properties->createCopyProperty("GPU memory (bytes)", gpuMemory)->setReadOnly(true);
+			properties->createCopyProperty("Saved by the compact formats (bytes)", savedMemory)->setReadOnly(true);
 		}
 		break;
 	}
@@ -357,7 +403,13 @@ void MeshDocument::closeObjectProperties(GraphNode* baseItem, ObjectPropertiesPt
 	if (item->nodeType == MeshNode::Type::Root || item->nodeType == MeshNode::Type::Node || item->nodeType == MeshNode::Type::Instance)
 		updateNodes(item);
 	else if (item->nodeType == MeshNode::Type::Mesh)
+	{
+		item->mesh->invalidateBounds(); // The vertices may have been edited
 		m_newMeshes.push_back(item->mesh.get());
+		m_lodGenerator.discard(item->mesh.get()); // The levels of the previous geometry
+		item->mesh->setLODs({});
+		generateLODs({ item->mesh.get() });
+	}
 	else if (item->nodeType == MeshNode::Type::Material)
 		m_newMaterials.push_back(item->material.get());
 }
@@ -406,43 +458,130 @@ void MeshDocument::createGraphImages()
 	m_graphMeshImages.push_back(m_graph.addImage(GraphImage::createDiskImage({ 0xffffa4a4 }))); // Materials group
 }
 
-void MeshDocument::updateNodes(MeshNode* item, const glm::mat4* transformation)
+void MeshDocument::updateNodes(MeshNode* item)
 {
-	glm::mat4 accTrans;
-	if(transformation)
-		accTrans = *transformation;
+	if (m_transformsModified || !m_transforms.valid(item->transformIndex) || m_transformNodes[item->transformIndex] != item)
+		buildTransforms();
+	else
+	{
+		for (auto node : m_newTransformNodes)
+		{
+			if (node)
+				updateLocalTransform(node);
+		}
 
-	if (item->nodeType == MeshNode::Type::Root)
+		updateLocalTransform(item);
+	}
+	m_newTransformNodes.clear();
+
+	if (item->nodeType == MeshNode::Type::Instance)
+		updateInstance(item);
+
+	// Only the modified subtrees are computed, then the instances are given to the renderer
+	m_transforms.update(m_modifiedTransforms);
+	for (auto index : m_modifiedTransforms)
 	{
-		accTrans = item->transformationMatrix * accTrans;
+		auto node = m_transformNodes[index];
+		if (!node || node->nodeType != MeshNode::Type::Instance)
+			continue;
+
+		const auto& world = m_transforms.world(index);
+		node->transformationMatrix = glm::transpose(world); // Global transformation
+		if (node->instance)
+			node->instance->setTransformation(world);
 	}
-	else if(item->nodeType == MeshNode::Type::Node)
+}
+
+void MeshDocument::addTransform(MeshNode* node)
+{
+	// The nodes created without parent (when loading a document) are added by the next complete build
+	auto parent = dynamic_cast<MeshNode*>(node->parent);
+	if (m_transformsModified || !parent || !m_transforms.valid(parent->transformIndex) || m_transformNodes[parent->transformIndex] != parent)
 	{
-		glm::mat4 transMat = toTransformationMatrix(item->transformationComponents);
-		accTrans = transMat * accTrans;
-		item->transformationMatrix = transMat; // Local transformation
+		m_transformsModified = true;
+		return;
 	}
-	else if (item->nodeType == MeshNode::Type::Instance)
+
+	node->transformIndex = m_transforms.add(parent->transformIndex);
+	if (node->transformIndex >= m_transformNodes.size())
+		m_transformNodes.resize(node->transformIndex + 1, nullptr);
+	m_transformNodes[node->transformIndex] = node;
+	m_newTransformNodes.push_back(node);
+}
+
+void MeshDocument::removeTransforms(MeshNode* item)
+{
+	if (m_transforms.valid(item->transformIndex) && m_transformNodes[item->transformIndex] == item)
+		m_transforms.remove(item->transformIndex);
+
+	graph::forEach(item, [this](GraphNode* baseNode) {
+		auto node = dynamic_cast<MeshNode*>(baseNode);
+		if (!node || node->transformIndex == simplerender::TransformHierarchy::invalid)
+			return;
+
+		if (node->transformIndex < m_transformNodes.size() && m_transformNodes[node->transformIndex] == node)
+			m_transformNodes[node->transformIndex] = nullptr;
+		node->transformIndex = simplerender::TransformHierarchy::invalid;
+		std::replace(m_newTransformNodes.begin(), m_newTransformNodes.end(), node, static_cast<MeshNode*>(nullptr));
+	});
+}
+
+void MeshDocument::buildTransforms()
+{
+	m_transforms.clear();
+	m_transformNodes.clear();
+	m_transformsModified = false;
+
+	auto root = dynamic_cast<MeshNode*>(m_rootNode.get());
+	if (!root)
+		return;
+
+	// Parents are visited before their children
+	graph::forEach(root, [this](GraphNode* baseNode) {
+		auto node = dynamic_cast<MeshNode*>(baseNode);
+		if (!node)
+			return;
+
+		node->transformIndex = simplerender::TransformHierarchy::invalid;
+		if (!hasTransform(node->nodeType))
+			return;
+
+		auto parent = dynamic_cast<MeshNode*>(node->parent);
+		const auto parentIndex = parent ? parent->transformIndex : simplerender::TransformHierarchy::invalid;
+		if (parentIndex == simplerender::TransformHierarchy::invalid && node->nodeType != MeshNode::Type::Root)
+			return; // Not in the tree of the root
+
+		node->transformIndex = m_transforms.add(parentIndex);
+		m_transformNodes.push_back(node);
+		updateLocalTransform(node);
+		if (node->nodeType == MeshNode::Type::Instance)
+			updateInstance(node);
+	});
+}
+
+void MeshDocument::updateLocalTransform(MeshNode* node)
+{
+	if (node->nodeType == MeshNode::Type::Root)
+		m_transforms.setLocal(node->transformIndex, glm::transpose(node->transformationMatrix));
+	else if (node->nodeType == MeshNode::Type::Node)
 	{
-		auto mesh = item->meshId != -1 ? m_scene.meshes()[item->meshId] : nullptr;
-		auto material = item->materialId != -1 ? m_scene.materials()[item->materialId] : nullptr;
-		item->mesh = mesh;
-		item->material = material;
-		if (transformation)
-		{
-			item->transformationMatrix = *transformation; // Global transformation
-			item->instance->transformation = glm::transpose(*transformation);
-		}
-		item->instance->mesh = mesh;
-		item->instance->material = material;
-		
+		const auto local = localTransformation(node->transformationComponents);
+		m_transforms.setLocal(node->transformIndex, local);
+		node->transformationMatrix = glm::transpose(local); // Local transformation
 	}
+	// The instances only use the transformation of their parent
+}
 
-	for (auto child : item->children)
+void MeshDocument::updateInstance(MeshNode* node)
+{
+	auto mesh = node->meshId != -1 ? m_scene.meshes()[node->meshId] : nullptr;
+	auto material = node->materialId != -1 ? m_scene.materials()[node->materialId] : nullptr;
+	node->mesh = mesh;
+	node->material = material;
+	if (node->instance)
 	{
-		auto node = dynamic_cast<MeshNode*>(child.get());
-		if (node)
-			updateNodes(node, &accTrans);
+		node->instance->mesh = mesh;
+		node->instance->material = material;
 	}
 }
 
@@ -461,6 +600,7 @@ void MeshDocument::removeNode(MeshNode* item)
 			removeValue(m_scene.instances(), node->instance);
 
 		// Remove the node
+		removeTransforms(item);
 		m_graph.removeChild(item->parent, item);
 
 		// Update the view if any changes were made
@@ -475,7 +615,7 @@ void MeshDocument::addInstance(MeshNode* parent)
 	auto instance = std::make_shared<simplerender::ModelInstance>();
 	node->instance = instance;
 	m_scene.addInstance(instance);
-	updateNodes(parent);
+	updateNodes(node.get());
 }
 
 void MeshDocument::removeInstance(MeshNode* item)
@@ -490,6 +630,10 @@ void MeshDocument::addMesh()
 	auto root = m_rootNode.get();
 	auto node = createNode(createNewName(root, MeshNode::Type::Mesh, "Mesh "), MeshNode::Type::Mesh, m_meshesGroup);
 	auto mesh = std::make_shared<simplerender::Mesh>();
+	mesh->setStorageMode(simplerender::StorageMode::Static);
+	mesh->setAttributesFormat(simplerender::AttributesFormat::Compact);
+	mesh->setVertexLayout(simplerender::VertexLayout::Interleaved);
+	mesh->setBufferArenas(m_scene.bufferArenas());
 	node->mesh = mesh;
 	m_scene.addMesh(mesh);
 }
@@ -566,6 +710,8 @@ void MeshDocument::removeDuplicateMeshes()
 			instanceNode->meshId = indexOf(m_scene.meshes(), mesh);
 		}
 	}
+
+	m_scene.defragmentArenas(); // The removed meshes left holes in the shared buffers
 }
 
 void MeshDocument::removeUnusedMeshes()
@@ -614,6 +760,8 @@ void MeshDocument::removeUnusedMeshes()
 		// Modifiy the scene's meshes list
 		auto last = std::remove_if(meshes.begin(), meshes.end(), isUnused);
 		meshes.erase(last, meshes.end());
+
+		m_scene.defragmentArenas(); // The removed meshes left holes in the shared buffers
 	}
 }
 
@@ -668,3 +816,21 @@ void MeshDocument::removeUnusedMaterials()
 		materials.erase(last, materials.end());
 	}
 }
+
+void MeshDocument::generateLODs()
+{
+	m_lodGenerator.generate(m_scene.meshes());
+}
+
+void MeshDocument::generateLODs(const std::vector<simplerender::Mesh*>& meshes)
+{
+	// The generator keeps a weak pointer to each mesh, to give them the levels when they are ready
+	simplerender::Scene::Meshes list;
+	for (const auto& mesh : m_scene.meshes())
+	{
+		if (std::find(meshes.begin(), meshes.end(), mesh.get()) != meshes.end())
+			list.push_back(mesh);
+	}
+
+	m_lodGenerator.generate(list);
+}
@@ -3,8 +3,11 @@
 #include <core/BaseDocument.h>
 #include <core/Graph.h>
 #include <core/MouseManipulator.h>
+#include <core/RenderUI.h>
 
+#include <render/MeshDecimation.h>
 #include <render/Scene.h>
+#include <render/TransformHierarchy.h>
 #include <sfe/Simulation.h>
 
 struct TransformationComponents
@@ -34,6 +37,7 @@ public:
 	simplerender::Material::SPtr material; // Material & Instance
 	simplerender::ModelInstance::SPtr instance; // Instance
 	int meshId = -1, materialId = -1; // Instance
+	simplerender::TransformHierarchy::Index transformIndex = simplerender::TransformHierarchy::invalid; // Root & Node & Instance
 };
 
 //****************************************************************************//
@@ -70,11 +74,23 @@ public:
 	void removeDuplicateMeshes();
 	void removeUnusedMeshes();
 	void removeUnusedMaterials();
+	void generateLODs(); // Of every mesh, in the background
 
 protected:
 	void createGraphImages();
 
-	void updateNodes(MeshNode* item, const glm::mat4* transformation = nullptr);
+	void updateNodes(MeshNode* item); // After a modification of the item, updates the transformations of its subtree
+
+	// The transformations of the nodes are cached in a hierarchy, rebuilt only when it cannot be modified incrementally
+	void addTransform(MeshNode* node);
+	void removeTransforms(MeshNode* item); // Of the whole subtree
+	void buildTransforms();
+	void updateLocalTransform(MeshNode* node);
+	void updateInstance(MeshNode* node); // Mesh and material from their ids
+
+	void generateLODs(const std::vector<simplerender::Mesh*>& meshes); // Must be called before their initialization
+
+	void selectInstance(const simplerender::PickResult& result); // Double click in the view
 
 	void addNode(MeshNode* parent);
 	void removeNode(MeshNode* item);
@@ -87,6 +103,7 @@ protected:
 	Graph m_graph;
 	SofaMouseManipulator m_mouseManipulator;
 	simplegui::SimpleGUI* m_gui = nullptr;
+	RenderUI m_renderUI;
 	MeshNode *m_meshesGroup = nullptr, *m_materialsGroup = nullptr;
 
 	GraphNode::SPtr m_rootNode;
@@ -94,6 +111,14 @@ protected:
 	std::vector<int> m_graphMeshImages;
 	std::vector<simplerender::Mesh*> m_newMeshes;
 	std::vector<simplerender::Material*> m_newMaterials;
+
+	simplerender::TransformHierarchy m_transforms;
+	std::vector<MeshNode*> m_transformNodes; // For each index of the hierarchy
+	std::vector<MeshNode*> m_newTransformNodes; // Their local transformation is read at the next update (they are modified after their creation)
+	simplerender::TransformHierarchy::Indices m_modifiedTransforms;
+	bool m_transformsModified = true; // The hierarchy must be rebuilt
+
+	simplerender::LODGenerator m_lodGenerator; // Waits for its tasks when destroyed
 };
 
 inline Graph& MeshDocument::graph()
@@ -32,6 +32,10 @@ inline glm::vec3 convert(aiVector3D v)
 simplerender::Mesh::SPtr createMesh(const aiMesh* input)
 {
 	auto mesh = std::make_shared<simplerender::Mesh>();
+	mesh->setStorageMode(simplerender::StorageMode::Static);
+	mesh->setAttributesFormat(simplerender::AttributesFormat::Compact);
+	mesh->setVertexLayout(simplerender::VertexLayout::Interleaved);
+	mesh->setIndicesOptimization(simplerender::IndicesOptimization::VertexCacheAndFetch); // The vertices can be reordered, nothing refers to them yet
 	mesh->m_vertices.reserve(input->mNumVertices);
 	for (unsigned int j = 0; j < input->mNumVertices; ++j)
 		mesh->m_vertices.push_back(convert(input->mVertices[j]));
@@ -172,7 +176,7 @@ void MeshImport::parseMeshInstance(const aiScene* scene, unsigned int id, const
 	n->material = materialId != -1 ? m_scene.materials()[materialId] : nullptr;
 	n->transformationMatrix = transformation;
 	n->instance = std::make_shared<simplerender::ModelInstance>();
-	n->instance->transformation = glm::transpose(transformation);
+	n->instance->setTransformation(glm::transpose(transformation));
 	n->instance->mesh = n->mesh;
 	n->instance->material = n->material;
 	m_scene.addInstance(n->instance);
@@ -210,6 +214,7 @@ void MeshImport::addMeshes(const aiScene* scene)
 										   meshesGroup);
 
 		auto mesh = createMesh(inMesh);
+		mesh->setBufferArenas(m_scene.bufferArenas());
 		node->mesh = mesh;
 		int index = m_scene.meshes().size();
 		m_scene.addMesh(mesh);
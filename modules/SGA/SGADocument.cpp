@@ -371,6 +371,7 @@ void SGADocument::importMesh()
 
 	MeshImport importer(this, m_scene, m_graph);
 	std::tie(m_newMeshes, m_newMaterials) = importer.importMeshes(path);
+	generateLODs(m_newMeshes);
 }
 
 void SGADocument::addSGANode(GraphNode* parent, sga::ObjectDefinition::ObjectType type)
@@ -4,6 +4,10 @@
 #include <sfe/sofaFrontEndLocal.h>
 #include <sga/types.h>
 
+#include <render/VertexKernels.h>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
 #include <fstream>
 
 namespace sfe
@@ -65,6 +69,7 @@ struct CreationContext
 	bool hasSGAParent = false;
 	simplerender::Mesh::SPtr mesh;
 	simplerender::Material::SPtr material;
+	glm::mat4 meshTransformation; // Of the instance the mesh was copied from
 	sga::Transformation transformation;
 	sga::Vec3d boundingBox[2]; // min & max
 	int modifierIndex = 0;
@@ -224,7 +229,12 @@ void SGAExecution::convertObject(MeshNode* item, sgaExec::CreationContext& conte
 		updateModel.verticesData = visuModel.data("position");
 		updateModel.normalsData = visuModel.data("normal");
 		updateModel.mesh = context.mesh;
+		updateModel.mesh->setStorageMode(simplerender::StorageMode::Streaming); // Modified at every step
+		updateModel.mesh->setAttributesFormat(simplerender::AttributesFormat::Compact);
+		updateModel.mesh->setChangesDetection(true); // Upload only the modified vertices
 		updateModel.material = context.material;
+		updateModel.transformation = context.meshTransformation;
+		updateModel.frames = std::make_shared<simplerender::MeshFrameBuffer>();
 		m_updateModelStructs.push_back(updateModel);
 	}
 
@@ -240,6 +250,7 @@ void SGAExecution::convertMesh(MeshNode* item, sgaExec::CreationContext& context
 {
 	context.mesh = std::make_shared<simplerender::Mesh>(*item->instance->mesh); // Copy the mesh
 	context.material = item->instance->material; // Keep the same material
+	context.meshTransformation = item->instance->transformation();
 	context.name = item->name;
 
 	// Get the transformation and convert it for Sofa
@@ -368,6 +379,14 @@ void SGAExecution::run(CallbackFunc updateViewFunc)
 
 	for (auto& modelUdpate : m_updateModelStructs)
 	{
+		// The copy was given to Sofa in local coordinates with its transformation, but it is drawn without it until the first step
+		auto& mesh = *modelUdpate.mesh;
+		simplerender::transformPositions(modelUdpate.transformation, mesh.m_vertices.data(), mesh.m_vertices.data(), mesh.m_vertices.size());
+		const glm::mat4 normalsTransformation(glm::inverseTranspose(glm::mat3(modelUdpate.transformation))); // Without the translation
+		simplerender::transformPositions(normalsTransformation, mesh.m_normals.data(), mesh.m_normals.data(), mesh.m_normals.size());
+		simplerender::normalizeVectors(mesh.m_normals.data(), mesh.m_normals.size());
+		mesh.invalidateBounds();
+
 		auto instance = std::make_shared<simplerender::ModelInstance>();
 		instance->mesh = modelUdpate.mesh;
 		instance->material = modelUdpate.material;
@@ -396,11 +415,17 @@ void SGAExecution::render()
 			model.mesh->init();
 		m_meshesInitialized = true;
 	}
-	else if(m_updateMeshes)
+	else
 	{
+		// Take the newest frame published by the simulation thread (if any)
 		for (auto& model : m_updateModelStructs)
-			model.mesh->updatePositions();
-		m_updateMeshes = false;
+		{
+			if (model.frames->update())
+			{
+				model.mesh->swapFrame(model.frames->front());
+				model.mesh->updatePositions();
+			}
+		}
 	}
 
 	m_scene.render();
@@ -408,12 +433,14 @@ void SGAExecution::render()
 
 void SGAExecution::postStep()
 {
+	// Write in the back buffers, the render thread will take them when it is ready
 	for (auto& modelUpdate : m_updateModelStructs)
 	{
-		modelUpdate.verticesData.get(modelUpdate.mesh->m_vertices);
-		modelUpdate.normalsData.get(modelUpdate.mesh->m_normals);
+		auto& frame = modelUpdate.frames->back();
+		modelUpdate.verticesData.get(frame.vertices);
+		modelUpdate.normalsData.get(frame.normals);
+		modelUpdate.frames->publish();
 	}
 
-	m_updateMeshes = true;
 	m_updateViewFunc();
 }
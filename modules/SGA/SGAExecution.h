@@ -56,10 +56,12 @@ private:
 	{
 		simplerender::Mesh::SPtr mesh;
 		simplerender::Material::SPtr material;
+		glm::mat4 transformation; // Applied to the mesh until the simulation gives its positions
 		sfe::Data verticesData, normalsData;
+		std::shared_ptr<simplerender::MeshFrameBuffer> frames; // Written in the simulation thread, read in the render thread
 	};
 	std::vector<UpdateModelStruct> m_updateModelStructs;
 	CallbackFunc m_updateViewFunc;
-	bool m_meshesInitialized = false, m_updateMeshes = false;
+	bool m_meshesInitialized = false;
 	sfe::CallbackHandle m_stepCallbackHandle;
 };
\ No newline at end of file
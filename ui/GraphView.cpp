@@ -43,6 +43,19 @@ void GraphView::setDocument(std::shared_ptr<BaseDocument> doc)
 	});
 }
 
+void GraphView::selectNode(GraphNode* node)
+{
+	auto model = dynamic_cast<GraphModel*>(m_graph->model());
+	if (!model || !node)
+		return;
+
+	const auto index = model->index(node);
+	for (auto parent = index.parent(); parent.isValid(); parent = parent.parent())
+		m_graph->expand(parent);
+	m_graph->setCurrentIndex(index);
+	m_graph->scrollTo(index);
+}
+
 void GraphView::openItem(const QModelIndex& index)
 {
 	if (index.isValid())
@@ -18,6 +18,7 @@ public:
 	QWidget* view();
 
 	void setDocument(std::shared_ptr<BaseDocument> doc);
+	void selectNode(GraphNode* node); // Make it the current item, and scroll to it
 
 signals:
 	void itemOpened(void* item);
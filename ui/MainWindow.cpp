@@ -56,7 +56,7 @@ MainWindow::MainWindow(QWidget *parent)
 	statusBar();
 	
 	std::vector<QMenu*> menus = { m_fileMenu, m_toolsMenu, m_viewMenu, m_helpMenu };
-	m_simpleGUI = std::make_shared<SimpleGUIImpl>(this, m_openGLView, m_buttonsDockWidget, menus);
+	m_simpleGUI = std::make_shared<SimpleGUIImpl>(this, m_openGLView, m_graphView, m_buttonsDockWidget, menus);
 
 	connect(m_graphView, &GraphView::itemOpened, [this](void* item) {
 		m_simpleGUI->openPropertiesDialog(static_cast<GraphNode*>(item));
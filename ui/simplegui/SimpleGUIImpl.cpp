@@ -1,6 +1,7 @@
 #include <core/BaseDocument.h>
 #include <core/Graph.h>
 
+#include <ui/GraphView.h>
 #include <ui/MainWindow.h>
 #include <ui/PropertiesDialog.h>
 
@@ -13,9 +14,10 @@
 
 #include <QtWidgets>
 
-SimpleGUIImpl::SimpleGUIImpl(MainWindow* mainWindow, QWidget* view, QWidget* buttonsPanelContainer, const std::vector<QMenu*>& menus)
+SimpleGUIImpl::SimpleGUIImpl(MainWindow* mainWindow, QWidget* view, GraphView* graphView, QWidget* buttonsPanelContainer, const std::vector<QMenu*>& menus)
 	: m_mainWindow(mainWindow)
 	, m_mainView(view)
+	, m_graphView(graphView)
 	, m_buttonsPanelContainer(buttonsPanelContainer)
 	, m_mainMenus(menus)
 	, m_settings(std::make_shared<SettingsImpl>(mainWindow))
@@ -203,6 +205,12 @@ void SimpleGUIImpl::closeAllPropertiesDialogs()
 		dlg->reject();
 }
 
+void SimpleGUIImpl::selectNode(GraphNode* node)
+{
+	if (m_graphView)
+		m_graphView->selectNode(node);
+}
+
 std::vector<simplegui::SimpleGUI::ObjectPropertiesPair> SimpleGUIImpl::getOpenedPropertiesDialogs()
 {
 	std::lock_guard<std::mutex> lock(m_propertiesDialogsMutex);
@@ -230,6 +238,13 @@ simplegui::Settings& SimpleGUIImpl::settings()
 	return *m_settings;
 }
 
+std::string SimpleGUIImpl::cacheDirectory()
+{
+	const auto path = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/cache";
+	QDir().mkpath(path);
+	return path.toStdString();
+}
+
 void SimpleGUIImpl::closeDocument()
 {
 	auto ptr = m_mainWindow;
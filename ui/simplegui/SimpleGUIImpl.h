@@ -9,6 +9,7 @@
 class BaseDocument;
 class BasePropertyWidget;
 class GraphNode;
+class GraphView;
 class MainWindow;
 class ObjectProperties;
 class PropertiesDialog;
@@ -27,7 +28,7 @@ class QWidget;
 class SimpleGUIImpl : public simplegui::SimpleGUI
 {
 public:
-	SimpleGUIImpl(MainWindow* mainWindow, QWidget* view, QWidget* buttonsPanelContainer, const std::vector<QMenu*>& menus);
+	SimpleGUIImpl(MainWindow* mainWindow, QWidget* view, GraphView* graphView, QWidget* buttonsPanelContainer, const std::vector<QMenu*>& menus);
 
 	simplegui::Menu& getMenu(simplegui::MenuType menuType) override;
 	simplegui::Panel& buttonsPanel() override;
@@ -39,6 +40,7 @@ public:
 	int messageBox(simplegui::MessageBoxType type, const std::string& caption, const std::string& text, int buttons) override;
 	void updateView() override;
 	simplegui::Settings& settings() override;
+	std::string cacheDirectory() override;
 	void closeDocument() override;
 	void executeByUI(simplegui::CallbackFunc func) override;
 
@@ -49,6 +51,7 @@ public:
 	void closePropertiesDialog(GraphNode* node) override;
 	void closeAllPropertiesDialogs() override;
 	std::vector<ObjectPropertiesPair> getOpenedPropertiesDialogs() override;
+	void selectNode(GraphNode* node) override;
 	void dialogFinished(PropertiesDialog* dialog, int result);
 
 protected:
@@ -61,6 +64,7 @@ protected:
 
 	MainWindow* m_mainWindow;
 	QWidget* m_mainView;
+	GraphView* m_graphView;
 	QWidget* m_buttonsPanelContainer;
 	std::vector<QMenu*> m_mainMenus;
 	ExecuteByGUI* m_executeByGUI;